@@ -0,0 +1,169 @@
+#include "aggregate.hpp"
+#include <algorithm>
+#include <ctime>
+
+#define SECONDS_IN_HOUR 3600
+#define SECONDS_IN_DAY  86400
+
+// floor division, local seconds can be negative for timestamps near 0
+static int64_t floor_div(int64_t a, int64_t b) {
+    int64_t q = a / b;
+    if ((a % b != 0) && ((a < 0) != (b < 0))) q--;
+    return q;
+}
+
+//==============================TimeZoneTable==============================
+
+int32_t TimeZoneTable::offset_from_localtime(int64_t t) {
+    std::time_t tt = static_cast<std::time_t>(t);
+    std::tm tm_info;
+    localtime_r(&tt, &tm_info);
+    return static_cast<int32_t>(tm_info.tm_gmtoff);
+}
+
+TimeZoneTable::TimeZoneTable() : cached(0) {
+    const int64_t maxTime = UINT32_MAX;
+
+    int32_t current = offset_from_localtime(0);
+    starts.push_back(0);
+    offsets.push_back(current);
+
+    // Sample once a day, then find every change inside the day by bisection
+    for (int64_t lo = 0; lo < maxTime; lo += SECONDS_IN_DAY) {
+        int64_t probe = std::min(lo + SECONDS_IN_DAY, maxTime);
+        int32_t probeOffset = offset_from_localtime(probe);
+
+        int64_t from = lo;
+        while (probeOffset != current) {
+            int64_t low = from, high = probe;
+            while (high - low > 1) {
+                int64_t mid = low + (high - low) / 2;
+                if (offset_from_localtime(mid) == current) low = mid;
+                else high = mid;
+            }
+            current = offset_from_localtime(high);
+            starts.push_back(high);
+            offsets.push_back(current);
+            from = high;
+        }
+    }
+}
+
+int32_t TimeZoneTable::offset_at(time_record_type timestamp) {
+    int64_t t = timestamp;
+    if (t >= starts[cached] && (cached + 1 == starts.size() || t < starts[cached + 1]))
+        return offsets[cached];
+
+    auto it = std::upper_bound(starts.begin(), starts.end(), t);
+    cached = static_cast<size_t>(it - starts.begin()) - 1;
+    return offsets[cached];
+}
+
+size_t TimeZoneTable::get_period_count() const { return starts.size(); }
+
+//==============================Formatting=================================
+
+std::string format_local_bucket(int64_t localSeconds, BucketSize size) {
+    int64_t days = floor_div(localSeconds, SECONDS_IN_DAY);
+    int64_t secondOfDay = localSeconds - days * SECONDS_IN_DAY;
+
+    // Civil date from days since 1970-01-01 (proleptic Gregorian calendar)
+    int64_t z = days + 719468;
+    int64_t era = floor_div(z, 146097);
+    int64_t doe = z - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    int64_t day = doy - (153 * mp + 2) / 5 + 1;
+    int64_t month = mp < 10 ? mp + 3 : mp - 9;
+    int64_t year = yoe + era * 400 + (month <= 2 ? 1 : 0);
+
+    char text[32];
+    if (size == BucketSize::HOUR) {
+        snprintf(text, sizeof(text), "%04d-%02d-%02d %02d:00", static_cast<int>(year),
+                 static_cast<int>(month), static_cast<int>(day),
+                 static_cast<int>(secondOfDay / SECONDS_IN_HOUR));
+    } else {
+        snprintf(text, sizeof(text), "%04d-%02d-%02d", static_cast<int>(year),
+                 static_cast<int>(month), static_cast<int>(day));
+    }
+    return text;
+}
+
+//==============================Operators==================================
+
+DistinctOperator::DistinctOperator() : hasLast(false) {}
+
+bool DistinctOperator::push(const RecordType& record) {
+    if (hasLast && record == last) return false;
+    last = record;
+    hasLast = true;
+    return true;
+}
+
+BucketOperator::BucketOperator(BucketSize bucket, const std::string& outputName)
+    : bucketSeconds(bucket == BucketSize::HOUR ? SECONDS_IN_HOUR : SECONDS_IN_DAY),
+      size(bucket), hasBucket(false), bucketStart(0), count(0),
+      minTimestamp(0), maxTimestamp(0), bucketsWritten(0) {
+    out = fopen(outputName.c_str(), "w");
+    if (out) fprintf(out, "bucket,count,min,max\n");
+}
+
+BucketOperator::~BucketOperator() {
+    if (out) fclose(out);
+}
+
+void BucketOperator::flush_bucket() {
+    if (!hasBucket || !out) return;
+    fprintf(out, "%s,%zu,%u,%u\n", format_local_bucket(bucketStart, size).c_str(),
+            count, minTimestamp, maxTimestamp);
+    bucketsWritten++;
+}
+
+bool BucketOperator::push(const RecordType& record) {
+    time_record_type timestamp = record.get_timestamp();
+    int64_t local = static_cast<int64_t>(timestamp) + zones.offset_at(timestamp);
+    int64_t start = floor_div(local, bucketSeconds) * bucketSeconds;
+
+    if (!hasBucket || start != bucketStart) {
+        flush_bucket();
+        hasBucket = true;
+        bucketStart = start;
+        count = 0;
+        minTimestamp = timestamp;
+        maxTimestamp = timestamp;
+    }
+
+    count++;
+    minTimestamp = std::min(minTimestamp, timestamp);
+    maxTimestamp = std::max(maxTimestamp, timestamp);
+    return true;
+}
+
+void BucketOperator::finish() {
+    flush_bucket();
+    hasBucket = false;
+    if (out) fflush(out);
+}
+
+bool BucketOperator::is_open() const { return out != nullptr; }
+size_t BucketOperator::get_buckets_written() const { return bucketsWritten; }
+
+//==============================Pipeline===================================
+
+void AggregatePipeline::add(std::unique_ptr<RecordOperator> op) {
+    operators.push_back(std::move(op));
+}
+
+bool AggregatePipeline::empty() const { return operators.empty(); }
+
+bool AggregatePipeline::push(const RecordType& record) {
+    for (auto& op : operators) {
+        if (!op->push(record)) return false;
+    }
+    return true;
+}
+
+void AggregatePipeline::finish() {
+    for (auto& op : operators) op->finish();
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "recordType.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define DEFAULT_AGGREGATE_FILENAME "aggregate.csv"
+
+// Local time offsets for the whole time_record_type range, built once from
+// localtime so that bucketing a record is plain arithmetic
+class TimeZoneTable {
+private:
+    // Start of every period with a constant offset, ascending
+    std::vector<int64_t> starts;
+    std::vector<int32_t> offsets;
+    // Period of the previous lookup, sorted input hits it almost every time
+    size_t cached;
+
+    static int32_t offset_from_localtime(int64_t t);
+
+public:
+    TimeZoneTable();
+
+    int32_t offset_at(time_record_type timestamp);
+    size_t get_period_count() const;
+};
+
+enum class BucketSize { HOUR, DAY };
+
+// Stage of the pipeline fed with the sorted stream of the last merge phase
+class RecordOperator {
+public:
+    virtual ~RecordOperator() = default;
+
+    // Returns false when the record must not reach later stages and the tape
+    virtual bool push(const RecordType& record) = 0;
+    virtual void finish() {}
+};
+
+// Drops repeated timestamps, the stream is sorted so they are adjacent
+class DistinctOperator : public RecordOperator {
+private:
+    RecordType last;
+    bool hasLast;
+
+public:
+    DistinctOperator();
+    bool push(const RecordType& record) override;
+};
+
+// Counts records and tracks min/max per local hour or day, writes one CSV line per bucket
+class BucketOperator : public RecordOperator {
+private:
+    TimeZoneTable zones;
+    int64_t bucketSeconds;
+    BucketSize size;
+    FILE* out;
+
+    bool hasBucket;
+    int64_t bucketStart;    // in local seconds since epoch
+    size_t count;
+    time_record_type minTimestamp;
+    time_record_type maxTimestamp;
+    size_t bucketsWritten;
+
+    void flush_bucket();
+
+public:
+    BucketOperator(BucketSize bucket, const std::string& outputName);
+    ~BucketOperator();
+
+    bool push(const RecordType& record) override;
+    void finish() override;
+
+    bool is_open() const;
+    size_t get_buckets_written() const;
+};
+
+class AggregatePipeline {
+private:
+    std::vector<std::unique_ptr<RecordOperator>> operators;
+
+public:
+    void add(std::unique_ptr<RecordOperator> op);
+    bool empty() const;
+
+    bool push(const RecordType& record);
+    void finish();
+};
+
+// "YYYY-MM-DD" or "YYYY-MM-DD HH:00" for local seconds since epoch, without localtime
+std::string format_local_bucket(int64_t localSeconds, BucketSize size);
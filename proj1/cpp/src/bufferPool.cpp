@@ -0,0 +1,160 @@
+#include "bufferPool.hpp"
+#include "logger.hpp"
+
+namespace Counts{
+    std::atomic<size_t> totalHitCount{0}, totalMissCount{0};
+}
+
+
+BufferPool::BufferPool(size_t frameCount, EvictionPolicy evictionPolicy)
+    : frames(frameCount), policy(evictionPolicy), useClock(0), hitCount(0), missCount(0) {
+    for (Frame& frame : frames) {
+        frame.tape = nullptr;
+        frame.blockNum = 0;
+        frame.pinCount = 0;
+        frame.dirty = false;
+        frame.valid = false;
+        frame.lastUse = 0;
+    }
+}
+
+size_t BufferPool::find_victim() const {
+    size_t victim = frames.size();
+    for (size_t i = 0; i < frames.size(); ++i) {
+        if (frames[i].pinCount > 0) continue;
+        if (!frames[i].valid) return i;
+
+        if (victim == frames.size()) victim = i;
+        else if (policy == EvictionPolicy::LRU && frames[i].lastUse < frames[victim].lastUse) victim = i;
+        else if (policy == EvictionPolicy::MRU && frames[i].lastUse > frames[victim].lastUse) victim = i;
+    }
+    return victim;
+}
+
+void BufferPool::write_back(Frame& frame) {
+    if (!frame.dirty) return;
+
+    if (frame.records.empty()) {
+        // write_block treats a count of 0 as a full block, write padding explicitly
+        std::vector<RecordType> padding(frame.tape->get_num_of_record_in_block());
+        frame.tape->write_block(frame.blockNum, padding.data(), padding.size());
+    } else {
+        frame.tape->write_block(frame.blockNum, frame.records.data(), frame.records.size());
+    }
+    frame.dirty = false;
+}
+
+void BufferPool::release(size_t index) {
+    Frame& frame = frames[index];
+    if (frame.valid) pageTable.erase({frame.tape, frame.blockNum});
+    frame.valid = false;
+    frame.dirty = false;
+    frame.tape = nullptr;
+    frame.records.clear();
+}
+
+std::vector<RecordType>* BufferPool::pin(Tape* tape, size_t blockNum, bool load) {
+    auto it = pageTable.find({tape, blockNum});
+    if (it != pageTable.end()) {
+        Frame& frame = frames[it->second];
+        frame.pinCount++;
+        frame.lastUse = ++useClock;
+        if (!load) frame.records.clear();
+        else {
+            hitCount++;
+            Counts::totalHitCount++;
+        }
+        return &frame.records;
+    }
+
+    size_t index = find_victim();
+    if (index == frames.size()) {
+        Logger::log("Buffer pool exhausted, all %zu frames are pinned!\n", frames.size());
+        return nullptr;
+    }
+
+    Frame& frame = frames[index];
+    if (frame.valid) write_back(frame);
+    release(index);
+
+    if (load) {
+        missCount++;
+        Counts::totalMissCount++;
+        if (!tape->read_block(blockNum, frame.records)) {
+            frame.records.clear();
+            return nullptr;
+        }
+    }
+
+    frame.tape = tape;
+    frame.blockNum = blockNum;
+    frame.pinCount = 1;
+    frame.dirty = false;
+    frame.valid = true;
+    frame.lastUse = ++useClock;
+    pageTable[{tape, blockNum}] = index;
+    return &frame.records;
+}
+
+void BufferPool::unpin(Tape* tape, size_t blockNum, bool dirty) {
+    auto it = pageTable.find({tape, blockNum});
+    if (it == pageTable.end()) return;
+
+    Frame& frame = frames[it->second];
+    if (frame.pinCount > 0) frame.pinCount--;
+    frame.dirty = frame.dirty || dirty;
+    frame.lastUse = ++useClock;
+}
+
+std::vector<RecordType>* BufferPool::pin_scratch() {
+    size_t index = find_victim();
+    if (index == frames.size()) {
+        Logger::log("Buffer pool exhausted, all %zu frames are pinned!\n", frames.size());
+        return nullptr;
+    }
+
+    Frame& frame = frames[index];
+    if (frame.valid) write_back(frame);
+    release(index);
+
+    // Invalid but pinned, so it is neither looked up nor picked as a victim
+    frame.pinCount = 1;
+    frame.lastUse = ++useClock;
+    return &frame.records;
+}
+
+void BufferPool::unpin_scratch(std::vector<RecordType>* records) {
+    for (Frame& frame : frames) {
+        if (&frame.records != records) continue;
+        frame.pinCount = 0;
+        frame.records.clear();
+        return;
+    }
+}
+
+void BufferPool::flush(Tape* tape) {
+    for (Frame& frame : frames) {
+        if (frame.valid && frame.tape == tape) write_back(frame);
+    }
+}
+
+void BufferPool::drop(Tape* tape) {
+    for (size_t i = 0; i < frames.size(); ++i) {
+        if (frames[i].valid && frames[i].tape == tape) release(i);
+    }
+}
+
+void BufferPool::retarget(Tape* from, Tape* to) {
+    drop(to);
+    for (size_t i = 0; i < frames.size(); ++i) {
+        Frame& frame = frames[i];
+        if (!frame.valid || frame.tape != from) continue;
+        pageTable.erase({from, frame.blockNum});
+        frame.tape = to;
+        pageTable[{to, frame.blockNum}] = i;
+    }
+}
+
+size_t BufferPool::get_frame_count() const { return frames.size(); }
+size_t BufferPool::get_hit_count() const { return hitCount; }
+size_t BufferPool::get_miss_count() const { return missCount; }
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "tape.hpp"
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace Counts{
+    extern std::atomic<size_t> totalHitCount, totalMissCount;
+}
+
+enum class EvictionPolicy { LRU, MRU };
+
+// Fixed number of block frames shared by every tape the sort touches.
+// Blocks are pinned while in use, dirty frames are written back on eviction or flush.
+class BufferPool {
+private:
+    struct Frame {
+        Tape* tape;
+        size_t blockNum;
+        std::vector<RecordType> records;
+        size_t pinCount;
+        bool dirty;
+        bool valid;
+        size_t lastUse;
+    };
+
+    std::vector<Frame> frames;
+    std::map<std::pair<Tape*, size_t>, size_t> pageTable;
+    EvictionPolicy policy;
+    size_t useClock;
+    size_t hitCount;
+    size_t missCount;
+
+    // Returns frames.size() when every frame is pinned
+    size_t find_victim() const;
+    void write_back(Frame& frame);
+    void release(size_t index);
+
+public:
+    BufferPool(size_t frameCount, EvictionPolicy evictionPolicy = EvictionPolicy::LRU);
+
+    // Pins the block and returns its records, nullptr when no frame is free or the read fails.
+    // With load == false the block is about to be overwritten and is not read.
+    std::vector<RecordType>* pin(Tape* tape, size_t blockNum, bool load = true);
+    void unpin(Tape* tape, size_t blockNum, bool dirty);
+
+    // Lends a frame of no tape, e.g. merge scratch, so it counts against the pool.
+    // Returns nullptr when every frame is pinned; its contents are never written.
+    std::vector<RecordType>* pin_scratch();
+    void unpin_scratch(std::vector<RecordType>* records);
+
+    // Writes back every dirty frame of the tape, frames stay cached
+    void flush(Tape* tape);
+    // Forgets the tape's frames without writing them, for files that are removed
+    void drop(Tape* tape);
+    // Moves the frames of one tape to another after its file was renamed over it
+    void retarget(Tape* from, Tape* to);
+
+    size_t get_frame_count() const;
+    size_t get_hit_count() const;
+    size_t get_miss_count() const;
+};
@@ -0,0 +1,232 @@
+#include "incrementalSort.hpp"
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <queue>
+#include "logger.hpp"
+
+// Merges are written next to the base, so the rename over it stays on one filesystem
+#define COMPACTION_TEMP_SUFFIX ".compact.tmp"
+
+// Existence, not readability, so an unreadable delta fails the merge instead of
+// hiding the deltas after it
+static bool tape_exists(const std::string& name) {
+    std::error_code error;
+    return std::filesystem::exists(name, error);
+}
+
+IncrementalTape::IncrementalTape(const std::string& base, size_t block, size_t buffers, double ratio)
+    : baseName(base), blockSize(block), bufferNumber(buffers), compactionRatio(ratio) {}
+
+std::string IncrementalTape::delta_name(size_t index) const {
+    return baseName + ".delta" + std::to_string(index);
+}
+
+std::string IncrementalTape::temp_name() const {
+    return baseName + COMPACTION_TEMP_SUFFIX;
+}
+
+size_t IncrementalTape::get_delta_count() const {
+    size_t count = 0;
+    while (tape_exists(delta_name(count))) count++;
+    return count;
+}
+
+size_t IncrementalTape::tape_blocks(const std::string& name) const {
+    if (!tape_exists(name)) return 0;
+    Tape tape(name, blockSize);
+    return tape.get_total_blocks();
+}
+
+size_t IncrementalTape::base_blocks() const {
+    return tape_blocks(baseName);
+}
+
+size_t IncrementalTape::delta_blocks() const {
+    size_t blocks = 0;
+    size_t deltas = get_delta_count();
+    for (size_t i = 0; i < deltas; ++i) blocks += tape_blocks(delta_name(i));
+    return blocks;
+}
+
+bool IncrementalTape::merge_tapes(const std::vector<std::string>& names, RecordSink& sink) const {
+    std::vector<std::unique_ptr<Tape>> tapes;
+    std::vector<std::unique_ptr<TapeSource>> sources;
+
+    for (const std::string& name : names) {
+        auto tape = std::make_unique<Tape>(name, blockSize);
+        if (!tape->open(std::ios::in)) {
+            Logger::log("Failed to open %s!\n", name.c_str());
+            for (auto& opened : tapes) opened->close();
+            return false;
+        }
+        sources.push_back(std::make_unique<TapeSource>(*tape, 0, tape->get_total_blocks()));
+        tapes.push_back(std::move(tape));
+    }
+
+    // Min-heap: pair of (RecordType, sourceIndex)
+    auto cmp = [](const std::pair<RecordType, size_t>& a, const std::pair<RecordType, size_t>& b) {
+        return a.first.get_timestamp() > b.first.get_timestamp();
+    };
+    std::priority_queue<std::pair<RecordType, size_t>,
+                        std::vector<std::pair<RecordType, size_t>>,
+                        decltype(cmp)> minHeap(cmp);
+
+    RecordType record;
+    for (size_t i = 0; i < sources.size(); ++i) {
+        if (sources[i]->next(record)) minHeap.push({record, i});
+    }
+
+    while (!minHeap.empty()) {
+        auto [minRecord, sourceIdx] = minHeap.top();
+        minHeap.pop();
+        sink.write(minRecord);
+
+        if (sources[sourceIdx]->next(record)) minHeap.push({record, sourceIdx});
+    }
+    sink.finish();
+
+    for (auto& tape : tapes) tape->close();
+    return true;
+}
+
+bool IncrementalTape::merge_into(const std::vector<std::string>& names, const std::string& target) const {
+    std::string temp = temp_name();
+    Tape output(temp, blockSize);
+    if (!output.open(std::ios::in | std::ios::out | std::ios::trunc)) {
+        Logger::log("Failed to open compaction tape %s!\n", temp.c_str());
+        return false;
+    }
+    TapeSink sink(output);
+    bool merged = merge_tapes(names, sink);
+    output.close();
+
+    // rename replaces target atomically, the inputs stay until it succeeded
+    if (!merged || std::rename(temp.c_str(), target.c_str()) != 0) {
+        if (merged) Logger::log("Failed to rename %s to %s!\n", temp.c_str(), target.c_str());
+        std::remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool IncrementalTape::fold_last_deltas(size_t count) {
+    size_t deltas = get_delta_count();
+    if (count < 2 || count > deltas) return true;
+
+    size_t first = deltas - count;
+    std::vector<std::string> names;
+    for (size_t i = first; i < deltas; ++i) names.push_back(delta_name(i));
+
+    if (!merge_into(names, delta_name(first))) return false;
+    for (size_t i = first + 1; i < deltas; ++i) std::remove(delta_name(i).c_str());
+
+    Logger::log_verbose("Folded deltas %zu to %zu into delta %zu\n", first, deltas - 1, first);
+    return true;
+}
+
+bool IncrementalTape::append(RecordSource& batch) {
+    size_t index = get_delta_count();
+    std::string name = delta_name(index);
+
+    Tape delta(name, blockSize);
+    if (!delta.open(std::ios::in | std::ios::out | std::ios::trunc)) {
+        Logger::log("Failed to open delta tape %s!\n", name.c_str());
+        return false;
+    }
+
+    TapeSink sink(delta);
+    bool sorted = stream_sort(batch, sink, bufferNumber, blockSize);
+    delta.close();
+
+    if (!sorted) {
+        std::remove(name.c_str());
+        Logger::log("Batch was not appended\n");
+        return false;
+    }
+
+    if (sink.get_blocks_written() == 0) {
+        std::remove(name.c_str());
+        Logger::log_verbose("Empty batch, no delta written\n");
+        return true;
+    }
+
+    Logger::log_verbose("Appended delta %zu (%zu blocks)\n", index, sink.get_blocks_written());
+    return maybe_compact();
+}
+
+bool IncrementalTape::fold_to_fan_in(bool levels) {
+    // Base and every delta need an input buffer for single pass reads
+    size_t mergeWays = bufferNumber - 1;
+    size_t tapes = tape_exists(baseName) ? 1 : 0;
+
+    size_t deltas = get_delta_count();
+    while (deltas + tapes > mergeWays) {
+        size_t count = std::max<size_t>(2, deltas + tapes - mergeWays + 1);
+        count = std::min(count, std::min(mergeWays, deltas));
+
+        // Take in older deltas while they are no bigger than the newer ones, so deltas
+        // form levels of growing size and a record is rewritten about once per level
+        size_t suffixBlocks = 0;
+        for (size_t i = deltas - count; i < deltas; ++i) suffixBlocks += tape_blocks(delta_name(i));
+        while (levels && count < std::min(mergeWays, deltas)) {
+            size_t olderBlocks = tape_blocks(delta_name(deltas - count - 1));
+            if (olderBlocks > suffixBlocks) break;
+            suffixBlocks += olderBlocks;
+            count++;
+        }
+
+        if (!fold_last_deltas(count)) return false;
+        deltas = get_delta_count();
+    }
+    return true;
+}
+
+bool IncrementalTape::maybe_compact() {
+    if (bufferNumber < 3) {
+        Logger::log("Need at least 3 buffers for compaction\n");
+        return false;
+    }
+
+    size_t deltas = get_delta_count();
+    if (deltas == 0) return true;
+
+    // Only the ratio rewrites the base, a full fan-in just deepens the deltas
+    if (delta_blocks() >= compactionRatio * base_blocks()) return compact();
+    return fold_to_fan_in(true);
+}
+
+bool IncrementalTape::compact() {
+    if (bufferNumber < 3) {
+        Logger::log("Need at least 3 buffers for compaction\n");
+        return false;
+    }
+
+    if (get_delta_count() == 0) return true;
+
+    // Only folds when the deltas outgrew the fan-in, and then just the fewest
+    // newest ones, everything else is read once by the merge below
+    if (!fold_to_fan_in(false)) return false;
+    size_t deltas = get_delta_count();
+
+    std::vector<std::string> names;
+    if (tape_exists(baseName)) names.push_back(baseName);
+    for (size_t i = 0; i < deltas; ++i) names.push_back(delta_name(i));
+
+    if (!merge_into(names, baseName)) return false;
+    for (size_t i = 0; i < deltas; ++i) std::remove(delta_name(i).c_str());
+
+    Logger::log_verbose("Compacted %zu deltas into %s (%zu blocks)\n",
+                        deltas, baseName.c_str(), base_blocks());
+    return true;
+}
+
+bool IncrementalTape::read_all(RecordSink& sink) const {
+    std::vector<std::string> names;
+    if (tape_exists(baseName)) names.push_back(baseName);
+
+    size_t deltas = get_delta_count();
+    for (size_t i = 0; i < deltas; ++i) names.push_back(delta_name(i));
+
+    return merge_tapes(names, sink);
+}
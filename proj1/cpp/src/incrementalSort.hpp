@@ -0,0 +1,50 @@
+#pragma once
+
+#include "tape.hpp"
+#include "pipeSort.hpp"
+#include <string>
+
+// Deltas are compacted once they hold this fraction of the base tape's blocks
+#define DEFAULT_COMPACTION_RATIO 0.25
+
+// A sorted base tape plus sorted delta tapes "<base>.delta<N>" appended next to it.
+// Readers merge base and deltas on the fly, compaction folds the deltas into the base.
+class IncrementalTape {
+private:
+    std::string baseName;
+    size_t blockSize;
+    size_t bufferNumber;
+    double compactionRatio;
+
+    std::string delta_name(size_t index) const;
+    std::string temp_name() const;
+    size_t tape_blocks(const std::string& name) const;
+    size_t base_blocks() const;
+    size_t delta_blocks() const;
+
+    // Merges the given tapes into the sink in a single pass, fails if one cannot be opened
+    bool merge_tapes(const std::vector<std::string>& names, RecordSink& sink) const;
+    // Merges the given tapes into a temp tape and renames it over target
+    bool merge_into(const std::vector<std::string>& names, const std::string& target) const;
+    // Merges the newest count deltas into one, keeping delta numbering contiguous
+    bool fold_last_deltas(size_t count);
+    // Folds the newest deltas until base and deltas fit in one merge pass, with
+    // levels set it also takes in older deltas no bigger than the folded ones
+    bool fold_to_fan_in(bool levels);
+
+public:
+    IncrementalTape(const std::string& base, size_t block, size_t buffers,
+                    double ratio = DEFAULT_COMPACTION_RATIO);
+
+    // Sorts the batch into a new delta; cost depends only on the batch size
+    bool append(RecordSource& batch);
+    // Folds all deltas into the base with one merge pass
+    bool compact();
+    // Compacts when the deltas crossed the size ratio, folds deltas into deeper
+    // ones when they outgrew the merge fan-in
+    bool maybe_compact();
+    // Streams base and deltas merged in order
+    bool read_all(RecordSink& sink) const;
+
+    size_t get_delta_count() const;
+};
@@ -4,12 +4,13 @@
 namespace Logger
 {
     bool verbose = false;
+    FILE* output = stdout;
 
     void log(const char* fmt, ...)
     {
         va_list args;
         va_start(args, fmt);
-        vprintf(fmt, args);
+        vfprintf(output, fmt, args);
         va_end(args);
     }
 
@@ -18,7 +19,7 @@ namespace Logger
         if (!verbose) return;
         va_list args;
         va_start(args, fmt);
-        vprintf(fmt, args);
+        vfprintf(output, fmt, args);
         va_end(args);
     }
 }
@@ -6,6 +6,8 @@
 namespace Logger
 {
     extern bool verbose;
+    // Where messages go, stderr when stdout carries sorted data
+    extern FILE* output;
 
     void log(const char* fmt, ...);
     void log_verbose(const char* fmt, ...);
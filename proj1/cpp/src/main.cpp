@@ -1,6 +1,16 @@
 #include "tape.hpp"
 #include "tapeSort.hpp"
+#include "topK.hpp"
+#include "aggregate.hpp"
+#include "pipeSort.hpp"
+#include "incrementalSort.hpp"
+#include "mergeKernel.hpp"
+#include "sampleSort.hpp"
+#include "verify.hpp"
+#include "sortDaemon.hpp"
+#include <filesystem>
 #include <getopt.h>
+#include <cstdlib>
 #include <string>
 #include "logger.hpp"
 
@@ -16,6 +26,25 @@ int main(int argc, char* argv[]){
     std::string filename = DEFAULT_FILENAME;
     std::string loadFromFile = "";
     bool        loadFromKeyboard = false;
+    size_t      topK     = 0;
+    bool        topLargest = false;
+    bool        distinct = false;
+    std::string groupBy  = "";
+    std::string pipeFormat = "";
+    std::string appendFrom = "";
+    bool        compact  = false;
+    std::string exportFormat = "";
+    EvictionPolicy eviction = EvictionPolicy::LRU;
+    size_t      samplePartitions = 0;
+    bool        keepShards = false;
+    bool        verify   = false;
+    bool        check    = false;
+    std::string daemonSocket = "";
+    size_t      maxJobs  = 0;
+    std::string submitSocket = "";
+    std::string outputFile = "";
+    std::string statusSocket = "";
+    std::string shutdownSocket = "";
 
     static struct option long_opts[] = {
         {"help",        no_argument,        0,  'h'},
@@ -26,11 +55,31 @@ int main(int argc, char* argv[]){
         {"verbose",     no_argument,        0,  'v'},
         {"load-file",   required_argument,  0,  'l'},
         {"load-keyboard",no_argument,       0,  'k'},
+        {"top",         required_argument,  0,  't'},
+        {"bottom",      required_argument,  0,  'B'},
+        {"distinct",    no_argument,        0,  'd'},
+        {"group-by",    required_argument,  0,  'g'},
+        {"pipe",        required_argument,  0,  'P'},
+        {"append",      required_argument,  0,  'a'},
+        {"compact",     no_argument,        0,  'c'},
+        {"export",      required_argument,  0,  'e'},
+        {"eviction",    required_argument,  0,  'E'},
+        {"merge-kernel",required_argument,  0,  'K'},
+        {"sample-sort", required_argument,  0,  'S'},
+        {"shards",      no_argument,        0,  'H'},
+        {"verify",      no_argument,        0,  'V'},
+        {"check",       no_argument,        0,  'C'},
+        {"daemon",      required_argument,  0,  'D'},
+        {"jobs",        required_argument,  0,  'j'},
+        {"submit",      required_argument,  0,  's'},
+        {"output",      required_argument,  0,  'o'},
+        {"status",      required_argument,  0,  'Q'},
+        {"shutdown",    required_argument,  0,  'X'},
 
         {0, 0, 0, 0}
     };
 
-    while ((opt = getopt_long(argc, argv, "hf:r:p:b:vl:k", long_opts, &long_index)) != -1) {
+    while ((opt = getopt_long(argc, argv, "hf:r:p:b:vl:kt:B:dg:P:a:ce:E:K:S:HVCD:j:s:o:Q:X:", long_opts, &long_index)) != -1) {
         switch (opt) {
             case 'h':   // Help
                 Logger::log("Usage: tape_sort [OPTIONS]\n"
@@ -43,6 +92,26 @@ int main(int argc, char* argv[]){
                            "  -v, --verbose         Enable verbose output\n"
                            "  -l, --load-file FILE  Load records from comma-separated text file\n"
                            "  -k, --load-keyboard   Load records from keyboard input\n"
+                           "  -t, --top K           Write only the K earliest records to top_k.bin\n"
+                           "  -B, --bottom K        Write only the K latest records to top_k.bin\n"
+                           "  -d, --distinct        Drop repeated timestamps from the sorted tape\n"
+                           "  -g, --group-by UNIT   Write count/min/max per local hour or day to aggregate.csv\n"
+                           "  -P, --pipe FORMAT     Sort records from stdin to stdout, FORMAT is bin or txt\n"
+                           "  -a, --append FILE     Add records from a text file as a sorted delta of the tape\n"
+                           "  -c, --compact         Fold all deltas into the sorted tape\n"
+                           "  -e, --export FORMAT   Write the tape merged with its deltas to stdout (bin or txt)\n"
+                           "  -E, --eviction POLICY Buffer pool eviction policy, lru or mru (default: lru)\n"
+                           "  -K, --merge-kernel K  Merge of up to 4 runs: auto, heap, scalar, sse4.1 or avx2 (default: auto)\n"
+                           "  -S, --sample-sort P   Sort by splitting into P key ranges sorted in parallel\n"
+                           "  -H, --shards          With --sample-sort keep the sorted ranges as separate files\n"
+                           "  -V, --verify          Check that --file is sorted and print its record count and checksum\n"
+                           "  -C, --check           Verify the sorted tape against the checksum of the input\n"
+                           "  -D, --daemon SOCKET   Serve sort jobs on a Unix socket, -b is the budget shared by all jobs\n"
+                           "  -j, --jobs N          Jobs the daemon runs at once (default: hardware threads)\n"
+                           "  -s, --submit SOCKET   Sort --file (or --load-file) into --output on the daemon, -b caps its buffers\n"
+                           "  -o, --output FILE     Sorted tape written by a --submit job\n"
+                           "  -Q, --status SOCKET   List the daemon's jobs\n"
+                           "  -X, --shutdown SOCKET Stop the daemon once its jobs are done\n"
                            "\n"
                            "Either specify a file or generate random records, not both.\n"
                            "If neither is specified, defaults to generating 1000 random records.\n");
@@ -104,6 +173,116 @@ int main(int argc, char* argv[]){
                     return 1;
                 }
                 break;
+            //==============These are exclusive to eachother=============
+            case 't':   // Earliest K records only
+            case 'B':   // Latest K records only
+                if (topK != 0) {
+                    Logger::log("Error: Cannot specify both --top and --bottom\n");
+                    return 1;
+                }
+                {
+                    long long value = std::atoll(optarg);
+                    if (value <= 0) {
+                        Logger::log("Error: K must be greater than 0\n");
+                        return 1;
+                    }
+                    topK = static_cast<size_t>(value);
+                }
+                topLargest = (opt == 'B');
+                break;
+            //===========================================================
+            case 'd':   // Deduplicate during the last merge phase
+                distinct = true;
+                break;
+            case 'g':   // Bucket during the last merge phase
+                groupBy = optarg;
+                if (groupBy != "hour" && groupBy != "day") {
+                    Logger::log("Error: --group-by must be hour or day\n");
+                    return 1;
+                }
+                break;
+            case 'P':   // Filter mode, messages must not mix with the data on stdout
+                pipeFormat = optarg;
+                if (pipeFormat != "bin" && pipeFormat != "txt") {
+                    Logger::log("Error: --pipe format must be bin or txt\n");
+                    return 1;
+                }
+                Logger::output = stderr;
+                break;
+            case 'a':   // Incremental ingest into an already sorted tape
+                appendFrom = optarg;
+                break;
+            case 'c':
+                compact = true;
+                break;
+            case 'e':
+                exportFormat = optarg;
+                if (exportFormat != "bin" && exportFormat != "txt") {
+                    Logger::log("Error: --export format must be bin or txt\n");
+                    return 1;
+                }
+                Logger::output = stderr;
+                break;
+            case 'E':
+                if (std::string(optarg) == "lru") eviction = EvictionPolicy::LRU;
+                else if (std::string(optarg) == "mru") eviction = EvictionPolicy::MRU;
+                else {
+                    Logger::log("Error: --eviction must be lru or mru\n");
+                    return 1;
+                }
+                break;
+            case 'K': {
+                std::string name = optarg;
+                MergeKernelType type;
+                if (name == "auto") type = MergeKernelType::AUTO;
+                else if (name == "heap") type = MergeKernelType::HEAP;
+                else if (name == "scalar") type = MergeKernelType::SCALAR;
+                else if (name == "sse4.1") type = MergeKernelType::SSE41;
+                else if (name == "avx2") type = MergeKernelType::AVX2;
+                else {
+                    Logger::log("Error: Unknown merge kernel %s\n", name.c_str());
+                    return 1;
+                }
+                if (!select_merge_kernel(type)) {
+                    Logger::log("Error: Merge kernel %s is not supported by this CPU\n", name.c_str());
+                    return 1;
+                }
+                break;
+            }
+            case 'S':   // Distribution sort instead of merge phases
+                samplePartitions = std::stoi(optarg);
+                if (samplePartitions < 2) {
+                    Logger::log("Error: --sample-sort needs at least 2 partitions\n");
+                    return 1;
+                }
+                break;
+            case 'H':
+                keepShards = true;
+                break;
+            case 'V':
+                verify = true;
+                break;
+            case 'C':
+                check = true;
+                break;
+            case 'D':   // Sort service, see sortDaemon.hpp
+                daemonSocket = optarg;
+                break;
+            case 'j':
+                maxJobs = std::stoi(optarg);
+                break;
+            case 's':
+                submitSocket = optarg;
+                break;
+            case 'o':
+                outputFile = optarg;
+                break;
+            case 'Q':
+                statusSocket = optarg;
+                break;
+            case 'X':
+                shutdownSocket = optarg;
+                break;
             default:
                 return 1;
         }
@@ -113,16 +292,129 @@ int main(int argc, char* argv[]){
                 "File sorting with large buffer merging\n"
                 "=========================================\n\n");
 
+    // Daemon clients only send a request, the daemon has the page size and buffers
+    if (!statusSocket.empty()) return send_daemon_request(statusSocket, "STATUS");
+    if (!shutdownSocket.empty()) return send_daemon_request(shutdownSocket, "SHUTDOWN");
+    if (!submitSocket.empty()) {
+        if (outputFile.empty()) {
+            Logger::log("Error: --submit requires --output\n");
+            return 1;
+        }
+        // The daemon does not share our working directory
+        std::string input = loadFromFile.empty() ? filename : loadFromFile;
+        std::string request = "SORT " + std::filesystem::absolute(input).string() + " "
+                            + std::filesystem::absolute(outputFile).string();
+        if (!loadFromFile.empty()) request += " txt";
+        if (buffers != 0) request += " buffers=" + std::to_string(buffers);
+        if (check) request += " check";
+        return send_daemon_request(submitSocket, request);
+    }
+
     // Check if pageSize or buffers are not set
     if (pageSize == 0) {
         Logger::log("Error: pageSize must be specified\n");
         return 1;
     }
+
+    // Verification needs no buffers, it only reads the tape
+    if (verify) {
+        VerifyResult result = verify_tape(filename, pageSize);
+        log_verify_result(filename, result);
+        Logger::log_verbose("\nStats:\n");
+        Logger::log_verbose("Total read count %ld\n",   Counts::totalReadCount.load());
+        return result.readable && result.sorted ? 0 : 1;
+    }
+
     if (buffers == 0) {
         Logger::log("Error: buffers must be specified\n");
         return 1;
     }
 
+    if (!daemonSocket.empty()) return run_daemon(daemonSocket, pageSize, buffers, maxJobs);
+
+    if (topK != 0 && (distinct || !groupBy.empty())) {
+        Logger::log("Error: --distinct and --group-by cannot be used with --top/--bottom\n");
+        return 1;
+    }
+
+    // Operators fused into the last merge phase
+    AggregatePipeline pipeline;
+    BucketOperator* buckets = nullptr;
+    if (distinct) pipeline.add(std::make_unique<DistinctOperator>());
+    if (!groupBy.empty()) {
+        auto op = std::make_unique<BucketOperator>(groupBy == "hour" ? BucketSize::HOUR : BucketSize::DAY,
+                                                   DEFAULT_AGGREGATE_FILENAME);
+        if (!op->is_open()) {
+            Logger::log("Error: Cannot open %s\n", DEFAULT_AGGREGATE_FILENAME);
+            return 1;
+        }
+        buckets = op.get();
+        pipeline.add(std::move(op));
+    }
+
+    if (!pipeFormat.empty()) {
+        if (filename != DEFAULT_FILENAME || records != 0 || !loadFromFile.empty() || loadFromKeyboard || topK != 0) {
+            Logger::log("Error: --pipe reads stdin and cannot be combined with other inputs or --top/--bottom\n");
+            return 1;
+        }
+
+        std::unique_ptr<RecordSource> source;
+        std::unique_ptr<RecordSink> sink;
+        if (pipeFormat == "bin") {
+            source = std::make_unique<BinaryStreamSource>(stdin);
+            sink = std::make_unique<BinaryStreamSink>(stdout);
+        } else {
+            source = std::make_unique<TextStreamSource>(stdin);
+            sink = std::make_unique<TextStreamSink>(stdout);
+        }
+
+        if (!stream_sort(*source, *sink, buffers, pageSize, &pipeline)) return 1;
+
+        if (buckets) {
+            Logger::log("%zu buckets written to %s\n", buckets->get_buckets_written(), DEFAULT_AGGREGATE_FILENAME);
+        }
+        Logger::log_verbose("\nStats:\n");
+        Logger::log_verbose("Total read count %ld\n",   Counts::totalReadCount.load());
+        Logger::log_verbose("Total write count %ld\n",  Counts::totalWriteCount.load());
+        return 0;
+    }
+
+    if (!appendFrom.empty() || compact || !exportFormat.empty()) {
+        if (records != 0 || !loadFromFile.empty() || loadFromKeyboard || topK != 0 || !pipeline.empty()) {
+            Logger::log("Error: --append, --compact and --export only work on an existing sorted --file\n");
+            return 1;
+        }
+
+        IncrementalTape incremental(filename, pageSize, buffers);
+
+        if (!appendFrom.empty()) {
+            FILE* batchFile = fopen(appendFrom.c_str(), "r");
+            if (!batchFile) {
+                Logger::log("Error: Cannot open %s\n", appendFrom.c_str());
+                return 1;
+            }
+            TextStreamSource batch(batchFile);
+            bool appended = incremental.append(batch);
+            fclose(batchFile);
+            if (!appended) return 1;
+        }
+        if (compact && !incremental.compact()) return 1;
+
+        Logger::log("%s has %zu pending deltas\n", filename.c_str(), incremental.get_delta_count());
+
+        if (!exportFormat.empty()) {
+            std::unique_ptr<RecordSink> sink;
+            if (exportFormat == "bin") sink = std::make_unique<BinaryStreamSink>(stdout);
+            else sink = std::make_unique<TextStreamSink>(stdout);
+            if (!incremental.read_all(*sink)) return 1;
+        }
+
+        Logger::log_verbose("\nStats:\n");
+        Logger::log_verbose("Total read count %ld\n",   Counts::totalReadCount.load());
+        Logger::log_verbose("Total write count %ld\n",  Counts::totalWriteCount.load());
+        return 0;
+    }
+
     Tape tape(filename, pageSize);
 
     // Check if filename and records are both specified
@@ -152,7 +444,61 @@ int main(int argc, char* argv[]){
     tape.display();
     Logger::log("\n");
 
-    sort_tape(&tape, buffers);
+    if (samplePartitions != 0 && (topK != 0 || !pipeline.empty())) {
+        Logger::log("Error: --sample-sort cannot be combined with --top/--bottom, --distinct or --group-by\n");
+        return 1;
+    }
+    if (keepShards && samplePartitions == 0) {
+        Logger::log("Error: --shards requires --sample-sort\n");
+        return 1;
+    }
+    if (check && (topK != 0 || !pipeline.empty())) {
+        Logger::log("Error: --check only works for plain sorts, --top/--bottom, --distinct and --group-by change the records\n");
+        return 1;
+    }
+
+    VerifyResult inputCheck;
+    if (check) inputCheck = verify_tape(filename, pageSize);
+    size_t shardCount = 0;
+
+    if (topK != 0) top_k(&tape, topK, topLargest, buffers);
+    else if (samplePartitions != 0) {
+        if (!sample_sort(&tape, buffers, samplePartitions, keepShards, 0, &shardCount)) return 1;
+        if (!keepShards) {
+            Logger::log("Sorted file contents:\n");
+            tape.display();
+        }
+
+        Logger::log_verbose("\nStats:\n");
+        Logger::log_verbose("Total read count %ld\n",   Counts::totalReadCount.load());
+        Logger::log_verbose("Total write count %ld\n",  Counts::totalWriteCount.load());
+    }
+    else sort_tape(&tape, buffers, &pipeline, eviction);
+
+    if (check) {
+        VerifyResult outputCheck;
+        if (keepShards) {
+            for (size_t i = 0; i < shardCount; ++i) {
+                combine_verify(outputCheck, verify_tape(filename + ".shard" + std::to_string(i), pageSize));
+            }
+        } else {
+            outputCheck = verify_tape(filename, pageSize);
+        }
+
+        Logger::log("\n");
+        log_verify_result("Input", inputCheck);
+        log_verify_result("Output", outputCheck);
+        if (!outputCheck.sorted || !same_records(inputCheck, outputCheck)) {
+            Logger::log("Check FAILED\n");
+            tape.close();
+            return 1;
+        }
+        Logger::log("Check passed\n");
+    }
+
+    if (buckets) {
+        Logger::log("\n%zu buckets written to %s\n", buckets->get_buckets_written(), DEFAULT_AGGREGATE_FILENAME);
+    }
 
     tape.close();
 
@@ -0,0 +1,227 @@
+#include "mergeKernel.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MERGE_KERNEL_X86 1
+#endif
+
+void merge_two_scalar(const time_record_type* a, size_t na,
+                      const time_record_type* b, size_t nb,
+                      time_record_type* out) {
+    size_t i = 0, j = 0, k = 0;
+
+    // Branchless: the comparison only selects values and advances indexes
+    while (i < na && j < nb) {
+        time_record_type x = a[i];
+        time_record_type y = b[j];
+        bool takeA = x <= y;
+        out[k++] = takeA ? x : y;
+        i += takeA;
+        j += !takeA;
+    }
+    while (i < na) out[k++] = a[i++];
+    while (j < nb) out[k++] = b[j++];
+}
+
+#ifdef MERGE_KERNEL_X86
+
+// Finishes a vector merge: the pending upper half and both tails are still sorted,
+// at least one tail is shorter than a vector
+static void merge_leftovers(const time_record_type* pending, size_t np,
+                            const time_record_type* a, size_t na,
+                            const time_record_type* b, size_t nb,
+                            time_record_type* out) {
+    time_record_type tmp[32];
+    if (na <= nb) {
+        merge_two_scalar(pending, np, a, na, tmp);
+        merge_two_scalar(tmp, np + na, b, nb, out);
+    } else {
+        merge_two_scalar(pending, np, b, nb, tmp);
+        merge_two_scalar(tmp, np + nb, a, na, out);
+    }
+}
+
+//==============================SSE4.1=====================================
+
+// Bitonic merge network of two sorted 4-vectors, lo gets the 4 smallest values
+__attribute__((target("sse4.1")))
+static inline void bitonic_merge_4(__m128i& lo, __m128i& hi) {
+    __m128i b = _mm_shuffle_epi32(hi, _MM_SHUFFLE(0, 1, 2, 3));
+    __m128i l = _mm_min_epu32(lo, b);
+    __m128i h = _mm_max_epu32(lo, b);
+
+    // Both halves are bitonic now, clean them with distance 2 then 1
+    __m128i t;
+    t = _mm_shuffle_epi32(l, _MM_SHUFFLE(1, 0, 3, 2));
+    l = _mm_blend_epi16(_mm_min_epu32(l, t), _mm_max_epu32(l, t), 0xF0);
+    t = _mm_shuffle_epi32(h, _MM_SHUFFLE(1, 0, 3, 2));
+    h = _mm_blend_epi16(_mm_min_epu32(h, t), _mm_max_epu32(h, t), 0xF0);
+
+    t = _mm_shuffle_epi32(l, _MM_SHUFFLE(2, 3, 0, 1));
+    l = _mm_blend_epi16(_mm_min_epu32(l, t), _mm_max_epu32(l, t), 0xCC);
+    t = _mm_shuffle_epi32(h, _MM_SHUFFLE(2, 3, 0, 1));
+    h = _mm_blend_epi16(_mm_min_epu32(h, t), _mm_max_epu32(h, t), 0xCC);
+
+    lo = l;
+    hi = h;
+}
+
+__attribute__((target("sse4.1")))
+static void merge_two_sse41(const time_record_type* a, size_t na,
+                            const time_record_type* b, size_t nb,
+                            time_record_type* out) {
+    const size_t W = 4;
+    if (na < W || nb < W) {
+        merge_two_scalar(a, na, b, nb, out);
+        return;
+    }
+
+    __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+    __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+    size_t i = W, j = W;
+
+    while (true) {
+        bitonic_merge_4(lo, hi);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), lo);
+        out += W;
+
+        // Next vector comes from the input with the smaller head
+        bool fromA = j >= nb || (i < na && a[i] <= b[j]);
+        if (fromA && i + W <= na) {
+            lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+            i += W;
+        } else if (!fromA && j + W <= nb) {
+            lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + j));
+            j += W;
+        } else {
+            break;
+        }
+    }
+
+    time_record_type pending[W];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(pending), hi);
+    merge_leftovers(pending, W, a + i, na - i, b + j, nb - j, out);
+}
+
+//==============================AVX2=======================================
+
+__attribute__((target("avx2")))
+static inline __m256i bitonic_clean_8(__m256i x) {
+    __m256i t;
+    t = _mm256_permute2x128_si256(x, x, 0x01);
+    x = _mm256_blend_epi32(_mm256_min_epu32(x, t), _mm256_max_epu32(x, t), 0xF0);
+    t = _mm256_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2));
+    x = _mm256_blend_epi32(_mm256_min_epu32(x, t), _mm256_max_epu32(x, t), 0xCC);
+    t = _mm256_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1));
+    x = _mm256_blend_epi32(_mm256_min_epu32(x, t), _mm256_max_epu32(x, t), 0xAA);
+    return x;
+}
+
+// Bitonic merge network of two sorted 8-vectors, lo gets the 8 smallest values
+__attribute__((target("avx2")))
+static inline void bitonic_merge_8(__m256i& lo, __m256i& hi) {
+    __m256i b = _mm256_permutevar8x32_epi32(hi, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+    __m256i l = _mm256_min_epu32(lo, b);
+    __m256i h = _mm256_max_epu32(lo, b);
+    lo = bitonic_clean_8(l);
+    hi = bitonic_clean_8(h);
+}
+
+__attribute__((target("avx2")))
+static void merge_two_avx2(const time_record_type* a, size_t na,
+                           const time_record_type* b, size_t nb,
+                           time_record_type* out) {
+    const size_t W = 8;
+    if (na < W || nb < W) {
+        merge_two_scalar(a, na, b, nb, out);
+        return;
+    }
+
+    __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a));
+    __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b));
+    size_t i = W, j = W;
+
+    while (true) {
+        bitonic_merge_8(lo, hi);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), lo);
+        out += W;
+
+        // Next vector comes from the input with the smaller head
+        bool fromA = j >= nb || (i < na && a[i] <= b[j]);
+        if (fromA && i + W <= na) {
+            lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+            i += W;
+        } else if (!fromA && j + W <= nb) {
+            lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + j));
+            j += W;
+        } else {
+            break;
+        }
+    }
+
+    time_record_type pending[W];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(pending), hi);
+    merge_leftovers(pending, W, a + i, na - i, b + j, nb - j, out);
+}
+
+#endif
+
+//==============================Dispatch===================================
+
+static MergeKernel currentKernel = merge_two_scalar;
+static const char* currentKernelName = "scalar";
+static bool kernelSelected = false;
+
+bool select_merge_kernel(MergeKernelType type) {
+    kernelSelected = true;
+
+#ifdef MERGE_KERNEL_X86
+    __builtin_cpu_init();
+    bool hasAvx2 = __builtin_cpu_supports("avx2");
+    bool hasSse41 = __builtin_cpu_supports("sse4.1");
+#else
+    bool hasAvx2 = false;
+    bool hasSse41 = false;
+#endif
+
+    if (type == MergeKernelType::AUTO) {
+        type = hasAvx2 ? MergeKernelType::AVX2
+             : hasSse41 ? MergeKernelType::SSE41
+             : MergeKernelType::SCALAR;
+    }
+
+    switch (type) {
+        case MergeKernelType::HEAP:
+            currentKernel = nullptr;
+            currentKernelName = "heap";
+            return true;
+        case MergeKernelType::SCALAR:
+            currentKernel = merge_two_scalar;
+            currentKernelName = "scalar";
+            return true;
+#ifdef MERGE_KERNEL_X86
+        case MergeKernelType::SSE41:
+            if (!hasSse41) return false;
+            currentKernel = merge_two_sse41;
+            currentKernelName = "sse4.1";
+            return true;
+        case MergeKernelType::AVX2:
+            if (!hasAvx2) return false;
+            currentKernel = merge_two_avx2;
+            currentKernelName = "avx2";
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+MergeKernel get_merge_kernel() {
+    if (!kernelSelected) select_merge_kernel(MergeKernelType::AUTO);
+    return currentKernel;
+}
+
+const char* get_merge_kernel_name() {
+    if (!kernelSelected) select_merge_kernel(MergeKernelType::AUTO);
+    return currentKernelName;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "recordType.hpp"
+#include <cstddef>
+
+// Fan-in up to which merge() uses the block merge kernel instead of the heap.
+// Such a group also pins two scratch frames of the buffer pool, so it is only
+// used when the fan-in plus three frames fit in -b.
+#define SMALL_FAN_IN 4
+
+enum class MergeKernelType { AUTO, HEAP, SCALAR, SSE41, AVX2 };
+
+// Merges two sorted arrays into out, which must hold na + nb values
+typedef void (*MergeKernel)(const time_record_type* a, size_t na,
+                            const time_record_type* b, size_t nb,
+                            time_record_type* out);
+
+// Picks the kernel, AUTO takes the widest one the CPU supports.
+// Returns false when the requested instruction set is not available.
+bool select_merge_kernel(MergeKernelType type);
+
+// Kernel picked by select_merge_kernel(), nullptr when merge() should use the heap
+MergeKernel get_merge_kernel();
+const char* get_merge_kernel_name();
+
+void merge_two_scalar(const time_record_type* a, size_t na,
+                      const time_record_type* b, size_t nb,
+                      time_record_type* out);
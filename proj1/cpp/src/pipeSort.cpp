@@ -0,0 +1,212 @@
+#include "pipeSort.hpp"
+#include "tapeSort.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include "logger.hpp"
+
+//==============================Sources and sinks==========================
+
+BinaryStreamSource::BinaryStreamSource(FILE* stream, size_t bufferRecords)
+    : in(stream), buffer(bufferRecords), pos(0), filled(0) {}
+
+bool BinaryStreamSource::next(RecordType& record) {
+    if (pos == filled) {
+        filled = fread(buffer.data(), sizeof(time_record_type), buffer.size(), in);
+        pos = 0;
+        if (filled == 0) return false;
+    }
+    record = buffer[pos++];
+    return true;
+}
+
+TextStreamSource::TextStreamSource(FILE* stream) : in(stream) {}
+
+bool TextStreamSource::next(RecordType& record) {
+    int c = getc(in);
+    while (true) {
+        // Skip separators
+        while (c != EOF && !isdigit(c)) c = getc(in);
+        if (c == EOF) return false;
+
+        uint64_t value = 0;
+        bool tooLarge = false;
+        while (c != EOF && isdigit(c)) {
+            value = value * 10 + (c - '0');
+            if (value > UINT32_MAX) tooLarge = true;
+            c = getc(in);
+        }
+
+        // Skip invalid entries
+        if (!tooLarge) {
+            record = static_cast<time_record_type>(value);
+            return true;
+        }
+    }
+}
+
+BinaryStreamSink::BinaryStreamSink(FILE* stream, size_t bufferRecords) : out(stream) {
+    buffer.reserve(bufferRecords);
+}
+
+void BinaryStreamSink::write(const RecordType& record) {
+    buffer.push_back(record.get_timestamp());
+    if (buffer.size() == buffer.capacity()) {
+        fwrite(buffer.data(), sizeof(time_record_type), buffer.size(), out);
+        buffer.clear();
+    }
+}
+
+void BinaryStreamSink::finish() {
+    if (!buffer.empty()) fwrite(buffer.data(), sizeof(time_record_type), buffer.size(), out);
+    buffer.clear();
+    fflush(out);
+}
+
+TextStreamSink::TextStreamSink(FILE* stream) : out(stream) {}
+
+void TextStreamSink::write(const RecordType& record) {
+    fprintf(out, "%u\n", record.get_timestamp());
+}
+
+void TextStreamSink::finish() {
+    fflush(out);
+}
+
+TapeSource::TapeSource(Tape& t, size_t startBlock, size_t end)
+    : tape(t), currentBlock(startBlock), endBlock(end), pos(0) {}
+
+bool TapeSource::next(RecordType& record) {
+    // Blocks holding only padding come back empty, keep reading past them
+    while (pos >= buffer.size()) {
+        if (currentBlock >= endBlock) return false;
+        if (!tape.read_block(currentBlock++, buffer)) return false;
+        pos = 0;
+    }
+    record = buffer[pos++];
+    return true;
+}
+
+TapeSink::TapeSink(Tape& t) : tape(t), blockNum(0) {
+    buffer.reserve(tape.get_num_of_record_in_block());
+}
+
+void TapeSink::write(const RecordType& record) {
+    buffer.push_back(record);
+    if (buffer.size() >= tape.get_num_of_record_in_block()) {
+        tape.write_block(blockNum++, buffer.data(), buffer.size());
+        buffer.clear();
+    }
+}
+
+void TapeSink::finish() {
+    if (!buffer.empty()) tape.write_block(blockNum++, buffer.data(), buffer.size());
+    buffer.clear();
+}
+
+size_t TapeSink::get_blocks_written() const { return blockNum; }
+
+//==============================Sorting====================================
+
+// Last stage of the final merge phase: hands records to the sink instead of the tape
+class SinkOperator : public RecordOperator {
+private:
+    RecordSink& sink;
+    AggregatePipeline* upstream;
+
+public:
+    SinkOperator(RecordSink& s, AggregatePipeline* p) : sink(s), upstream(p) {}
+
+    bool push(const RecordType& record) override {
+        if (!upstream || upstream->push(record)) sink.write(record);
+        return false;
+    }
+
+    void finish() override {
+        if (upstream) upstream->finish();
+        sink.finish();
+    }
+};
+
+bool stream_sort(RecordSource& source, RecordSink& sink, size_t bufferNumber, size_t blockSize,
+                 AggregatePipeline* pipeline) {
+    if (bufferNumber < 3) {
+        Logger::log("Need at least 3 buffers for stream sorting\n");
+        return false;
+    }
+
+    size_t recordsPerBlock = blockSize / sizeof(time_record_type);
+    size_t runCapacity = bufferNumber * recordsPerBlock;
+
+    std::vector<RecordType> buffer;
+    buffer.reserve(runCapacity);
+
+    Tape* scratch = nullptr;
+    std::string scratchName;
+    size_t runIndex = 0;
+    RecordType record;
+    bool more = true;
+    bool pending = false;
+
+    Logger::log_verbose("Creating runs from stream...\n");
+
+    while (more) {
+        buffer.clear();
+        if (pending && record.get_timestamp() != 0) buffer.push_back(record);
+        pending = false;
+
+        while (buffer.size() < runCapacity && (more = source.next(record))) {
+            if (record.get_timestamp() != 0) buffer.push_back(record);
+        }
+        // A full buffer only means a spill if the input goes on
+        if (more) more = pending = source.next(record);
+
+        std::sort(buffer.begin(), buffer.end());
+
+        // Whole input fits in memory, no tape is ever created
+        if (!more && runIndex == 0) {
+            Logger::log_verbose("Sorted %zu records in memory\n", buffer.size());
+            SinkOperator output(sink, pipeline);
+            for (const RecordType& r : buffer) output.push(r);
+            output.finish();
+            return true;
+        }
+
+        if (buffer.empty()) break;
+
+        if (!scratch) {
+            scratchName = create_scratch_file(PIPE_SCRATCH_PREFIX);
+            scratch = new Tape(scratchName, blockSize);
+            if (scratchName.empty() || !scratch->open(std::ios::in | std::ios::out | std::ios::trunc)) {
+                Logger::log("Failed to open scratch tape!\n");
+                delete scratch;
+                if (!scratchName.empty()) std::remove(scratchName.c_str());
+                return false;
+            }
+        }
+
+        // Runs are laid out as create_runs() leaves them, bufferNumber blocks each
+        size_t blocksNeeded = (buffer.size() + recordsPerBlock - 1) / recordsPerBlock;
+        for (size_t b = 0; b < blocksNeeded; ++b) {
+            size_t offset = b * recordsPerBlock;
+            size_t count = std::min(buffer.size() - offset, recordsPerBlock);
+            scratch->write_block(runIndex * bufferNumber + b, buffer.data() + offset, count);
+        }
+        runIndex++;
+    }
+
+    scratch->close();
+    Logger::log_verbose("Spilled %zu runs to %s\n", runIndex, scratchName.c_str());
+
+    // The sink operator rejects every record, so the last phase writes nothing back
+    AggregatePipeline finalStage;
+    finalStage.add(std::make_unique<SinkOperator>(sink, pipeline));
+    merge(scratch, bufferNumber, &finalStage);
+
+    scratch->close();
+    delete scratch;
+    // merge() only leaves its temp tape behind when it failed
+    std::remove(scratchName.c_str());
+    std::remove((scratchName + ".merge.tmp").c_str());
+    return true;
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "recordType.hpp"
+#include "tape.hpp"
+#include "aggregate.hpp"
+#include <cstdio>
+#include <vector>
+
+// Spilled runs go to a unique file under $TMPDIR, so pipes never share one
+#define PIPE_SCRATCH_PREFIX "tape_pipe_sort."
+
+// Produces records one by one, returns false once the input is exhausted
+class RecordSource {
+public:
+    virtual ~RecordSource() = default;
+    virtual bool next(RecordType& record) = 0;
+};
+
+// Receives the sorted records in order
+class RecordSink {
+public:
+    virtual ~RecordSink() = default;
+    virtual void write(const RecordType& record) = 0;
+    virtual void finish() {}
+};
+
+// Raw native-endian time_record_type values
+class BinaryStreamSource : public RecordSource {
+private:
+    FILE* in;
+    std::vector<time_record_type> buffer;
+    size_t pos, filled;
+
+public:
+    BinaryStreamSource(FILE* stream, size_t bufferRecords = 1024);
+    bool next(RecordType& record) override;
+};
+
+// Decimal values separated by anything that is not a digit (commas, spaces, newlines)
+class TextStreamSource : public RecordSource {
+private:
+    FILE* in;
+
+public:
+    TextStreamSource(FILE* stream);
+    bool next(RecordType& record) override;
+};
+
+class BinaryStreamSink : public RecordSink {
+private:
+    FILE* out;
+    std::vector<time_record_type> buffer;
+
+public:
+    BinaryStreamSink(FILE* stream, size_t bufferRecords = 1024);
+    void write(const RecordType& record) override;
+    void finish() override;
+};
+
+// One decimal value per line
+class TextStreamSink : public RecordSink {
+private:
+    FILE* out;
+
+public:
+    TextStreamSink(FILE* stream);
+    void write(const RecordType& record) override;
+    void finish() override;
+};
+
+// Reads blocks [startBlock, endBlock) of an already opened tape in order
+class TapeSource : public RecordSource {
+private:
+    Tape& tape;
+    size_t currentBlock, endBlock;
+    std::vector<RecordType> buffer;
+    size_t pos;
+
+public:
+    TapeSource(Tape& t, size_t startBlock, size_t endBlock);
+    bool next(RecordType& record) override;
+};
+
+// Writes consecutive blocks of an already opened tape, starting at block 0
+class TapeSink : public RecordSink {
+private:
+    Tape& tape;
+    std::vector<RecordType> buffer;
+    size_t blockNum;
+
+public:
+    TapeSink(Tape& t);
+    void write(const RecordType& record) override;
+    void finish() override;
+
+    size_t get_blocks_written() const;
+};
+
+// Sorts everything the source produces into the sink. Runs are formed straight
+// from the source; only input larger than bufferNumber blocks is spilled to a
+// scratch tape, whose final merge phase streams into the sink. Records equal to
+// 0 are padding on a tape and are dropped from the input.
+// Returns false when nothing could be sorted, e.g. with fewer than 3 buffers.
+bool stream_sort(RecordSource& source, RecordSink& sink, size_t bufferNumber, size_t blockSize,
+                 AggregatePipeline* pipeline = nullptr);
+
+// Same for any input iterator range and any callable taking a RecordType
+template <typename InputIt, typename SinkFunc>
+bool stream_sort(InputIt first, InputIt last, SinkFunc&& sinkFunc, size_t bufferNumber, size_t blockSize,
+                 AggregatePipeline* pipeline = nullptr) {
+    class IteratorSource : public RecordSource {
+    private:
+        InputIt it, end;
+    public:
+        IteratorSource(InputIt b, InputIt e) : it(b), end(e) {}
+        bool next(RecordType& record) override {
+            if (it == end) return false;
+            record = RecordType(*it);
+            ++it;
+            return true;
+        }
+    };
+
+    class FunctionSink : public RecordSink {
+    private:
+        SinkFunc& func;
+    public:
+        FunctionSink(SinkFunc& f) : func(f) {}
+        void write(const RecordType& record) override { func(record); }
+    };
+
+    IteratorSource source(first, last);
+    FunctionSink sink(sinkFunc);
+    return stream_sort(source, sink, bufferNumber, blockSize, pipeline);
+}
@@ -0,0 +1,268 @@
+#include "sampleSort.hpp"
+#include "tapeSort.hpp"
+#include "pipeSort.hpp"
+#include "mergeKernel.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <thread>
+#include "logger.hpp"
+
+struct Splitters {
+    std::vector<time_record_type> keys;    // unique, ascending
+    std::vector<bool> heavy;               // key was picked more than once
+};
+
+// Range bucket 2j holds keys in (keys[j-1], keys[j]], or (keys[j-1], keys[j]) when
+// keys[j] is heavy, in which case bucket 2j+1 holds only keys[j]
+static size_t bucket_of(const Splitters& splitters, time_record_type key) {
+    size_t j = std::lower_bound(splitters.keys.begin(), splitters.keys.end(), key) - splitters.keys.begin();
+    if (j < splitters.keys.size() && splitters.keys[j] == key && splitters.heavy[j]) return 2 * j + 1;
+    return 2 * j;
+}
+
+static Splitters pick_splitters(Tape* tape, size_t partitions) {
+    size_t totalBlocks = tape->get_total_blocks();
+    size_t sampleTarget = partitions * SAMPLE_OVERSAMPLING;
+    size_t sampleBlocks = std::min(totalBlocks, sampleTarget);
+
+    // One random record from each of evenly spaced blocks
+    std::mt19937 rng(std::random_device{}());
+    std::vector<time_record_type> sample;
+    std::vector<RecordType> block;
+    for (size_t i = 0; i < sampleBlocks; ++i) {
+        if (!tape->read_block(i * totalBlocks / sampleBlocks, block) || block.empty()) continue;
+        sample.push_back(block[rng() % block.size()].get_timestamp());
+    }
+    std::sort(sample.begin(), sample.end());
+
+    std::vector<time_record_type> picked;
+    for (size_t i = 1; i < partitions && !sample.empty(); ++i) {
+        picked.push_back(sample[i * sample.size() / partitions]);
+    }
+
+    Splitters splitters;
+    for (size_t i = 0; i < picked.size(); ++i) {
+        if (!splitters.keys.empty() && splitters.keys.back() == picked[i]) {
+            splitters.heavy.back() = true;
+        } else {
+            splitters.keys.push_back(picked[i]);
+            splitters.heavy.push_back(false);
+        }
+    }
+    return splitters;
+}
+
+// Sorts one partition tape and, unless shards are kept, writes it into the tape from firstBlock.
+// The partition file is only removed once it was written back, false when that failed.
+static bool sort_partition(const std::string& partName, bool equalKeys, size_t records,
+                           size_t bufferNumber, size_t blockSize,
+                           const std::string& tapeName, size_t firstBlock, bool keepShards) {
+    Tape part(partName, blockSize);
+    size_t recordsPerBlock = part.get_num_of_record_in_block();
+    size_t blocks = (records + recordsPerBlock - 1) / recordsPerBlock;
+
+    // In memory the partition takes all but one buffer, which reads its blocks
+    bool inMemory = !equalKeys && blocks < bufferNumber;
+    if (!equalKeys && !inMemory) {
+        // Too big for this worker's memory, sort it like any other tape
+        create_runs(&part, bufferNumber);
+        merge(&part, bufferNumber);
+        part.close();
+    }
+
+    if (keepShards && !inMemory) return true;
+
+    if (!part.open(std::ios::in | std::ios::out)) {
+        Logger::log("Failed to open partition %s!\n", partName.c_str());
+        return false;
+    }
+
+    Tape out(keepShards ? partName : tapeName, blockSize);
+    Tape* target = keepShards ? &part : &out;
+    if (!keepShards && !out.open(std::ios::in | std::ios::out)) {
+        Logger::log("Failed to open tape for partition %s!\n", partName.c_str());
+        part.close();
+        return false;
+    }
+
+    bool complete = true;
+    if (inMemory) {
+        std::vector<RecordType> buffer;
+        buffer.reserve(records);
+        TapeSource source(part, 0, blocks);
+        RecordType record;
+        while (source.next(record)) buffer.push_back(record);
+        std::sort(buffer.begin(), buffer.end());
+        complete = buffer.size() == records;
+
+        for (size_t b = 0; b < blocks && complete; ++b) {
+            size_t offset = b * recordsPerBlock;
+            size_t count = std::min(buffer.size() - offset, recordsPerBlock);
+            target->write_block((keepShards ? 0 : firstBlock) + b, buffer.data() + offset, count);
+        }
+    } else {
+        // Already sorted, copy block for block
+        std::vector<RecordType> block;
+        for (size_t b = 0; b < blocks && complete; ++b) {
+            complete = part.read_block(b, block);
+            if (complete) out.write_block(firstBlock + b, block.data(), block.size());
+        }
+    }
+
+    out.close();
+    part.close();
+    if (!complete) {
+        Logger::log("Failed to read partition %s!\n", partName.c_str());
+        return false;
+    }
+    if (!keepShards) std::remove(partName.c_str());
+    return true;
+}
+
+bool sample_sort(Tape* tape, size_t bufferNumber, size_t partitions, bool keepShards,
+                 size_t threads, size_t* shardCount) {
+    if (shardCount) *shardCount = 0;
+    if (!tape) return false;
+
+    if (partitions < 2 || bufferNumber < partitions + 1) {
+        Logger::log("Sample sort needs at least 2 partitions and one buffer per partition plus one\n");
+        return false;
+    }
+
+    if (!tape->open(std::ios::in)) {
+        Logger::log("Failed to open tape file!\n");
+        return false;
+    }
+
+    size_t blockSize = tape->get_block_size();
+    size_t recordsPerBlock = tape->get_num_of_record_in_block();
+    size_t totalBlocks = tape->get_total_blocks();
+
+    Splitters splitters = pick_splitters(tape, partitions);
+    size_t bucketCount = 2 * splitters.keys.size() + 1;
+
+    // The scatter pass holds a block per range bucket and per heavy key bucket plus
+    // the input block, heavy keys that do not fit go to their range bucket instead
+    size_t scatterBuffers = splitters.keys.size() + 2;
+    for (size_t i = 0; i < splitters.heavy.size(); ++i) {
+        if (!splitters.heavy[i]) continue;
+        if (scatterBuffers < bufferNumber) scatterBuffers++;
+        else splitters.heavy[i] = false;
+    }
+
+    Logger::log_verbose("Splitters: ");
+    for (size_t i = 0; i < splitters.keys.size(); ++i) {
+        Logger::log_verbose("%u%s ", splitters.keys[i], splitters.heavy[i] ? "*" : "");
+    }
+    Logger::log_verbose("\n");
+
+    // Scatter pass, one block buffer per partition that receives records
+    std::vector<std::unique_ptr<Tape>> parts(bucketCount);
+    std::vector<std::unique_ptr<TapeSink>> sinks(bucketCount);
+    std::vector<size_t> counts(bucketCount, 0);
+    std::vector<RecordType> block;
+
+    for (size_t b = 0; b < totalBlocks; ++b) {
+        if (!tape->read_block(b, block)) break;
+
+        for (const RecordType& record : block) {
+            size_t bucket = bucket_of(splitters, record.get_timestamp());
+            if (!sinks[bucket]) {
+                std::string name = tape->get_filename() + ".part" + std::to_string(bucket);
+                parts[bucket] = std::make_unique<Tape>(name, blockSize);
+                if (!parts[bucket]->open(std::ios::in | std::ios::out | std::ios::trunc)) {
+                    Logger::log("Failed to open partition %s!\n", name.c_str());
+                    tape->close();
+                    return false;
+                }
+                sinks[bucket] = std::make_unique<TapeSink>(*parts[bucket]);
+            }
+            sinks[bucket]->write(record);
+            counts[bucket]++;
+        }
+    }
+    tape->close();
+
+    // Partitions in key order with their place in the sorted tape
+    struct Partition {
+        std::string name;
+        bool equalKeys;
+        size_t records;
+        size_t firstBlock;
+    };
+    std::vector<Partition> partitionList;
+    size_t nextBlock = 0;
+
+    for (size_t bucket = 0; bucket < bucketCount; ++bucket) {
+        if (!sinks[bucket]) continue;
+        sinks[bucket]->finish();
+        parts[bucket]->close();
+
+        std::string name = parts[bucket]->get_filename();
+        if (keepShards) {
+            // Shards are numbered in key order
+            std::string shardName = tape->get_filename() + ".shard" + std::to_string(partitionList.size());
+            std::rename(name.c_str(), shardName.c_str());
+            name = shardName;
+        }
+
+        partitionList.push_back({name, bucket % 2 == 1, counts[bucket], nextBlock});
+        nextBlock += (counts[bucket] + recordsPerBlock - 1) / recordsPerBlock;
+
+        Logger::log_verbose("Partition %zu: %zu records%s\n", partitionList.size() - 1,
+                            counts[bucket], bucket % 2 == 1 ? " (single key)" : "");
+    }
+
+    if (!keepShards) {
+        // Partitions fill the truncated tape at disjoint block ranges
+        std::ofstream truncate(tape->get_filename(), std::ios::binary | std::ios::trunc);
+    }
+
+    // Memory is split between the workers
+    if (threads == 0) threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    // Every worker needs 3 buffers for create_runs/merge
+    size_t workers = std::max<size_t>(1, std::min({threads, partitionList.size(), bufferNumber / 3}));
+    size_t workerBuffers = bufferNumber / workers;
+
+    Logger::log_verbose("Sorting %zu partitions on %zu threads, %zu buffers each\n",
+                        partitionList.size(), workers, workerBuffers);
+
+    // Kernel choice is lazy, make it before the threads race for it
+    get_merge_kernel();
+
+    std::atomic<size_t> nextPartition{0};
+    std::atomic<bool> failed{false};
+    Counts::JobCounts* jobCounts = Counts::jobCounts;
+    std::vector<std::thread> workerThreads;
+    for (size_t w = 0; w < workers; ++w) {
+        workerThreads.emplace_back([&]() {
+            Counts::jobCounts = jobCounts;
+            size_t p;
+            while ((p = nextPartition++) < partitionList.size()) {
+                const Partition& part = partitionList[p];
+                if (!sort_partition(part.name, part.equalKeys, part.records, workerBuffers, blockSize,
+                                    tape->get_filename(), part.firstBlock, keepShards)) {
+                    failed = true;
+                }
+            }
+        });
+    }
+    for (std::thread& thread : workerThreads) thread.join();
+
+    if (failed) {
+        // Written partitions are gone, the others still hold their records
+        Logger::log("Sample sort failed, records of %s not written back are left in its partition files\n",
+                    tape->get_filename().c_str());
+        return false;
+    }
+
+    if (keepShards && !partitionList.empty()) {
+        Logger::log("Sorted shards: %s.shard0 to %s.shard%zu\n", tape->get_filename().c_str(),
+                    tape->get_filename().c_str(), partitionList.size() - 1);
+    }
+    if (shardCount) *shardCount = partitionList.size();
+    return true;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "tape.hpp"
+
+// Splitter candidates taken from the tape per partition
+#define SAMPLE_OVERSAMPLING 16
+
+// Distribution sort: P-1 splitters sampled from the tape route every record to a
+// partition tape "<tape>.part<N>" in one pass, then the partitions are sorted
+// independently on worker threads, in memory or with create_runs/merge when too big.
+// Splitters repeated in the sample get partitions of their own that need no sorting
+// while bufferNumber leaves a scatter buffer for them. Workers share bufferNumber,
+// each with at least 3 buffers.
+// With keepShards the sorted partitions are kept in key order and the tape is left
+// as it was, otherwise they are written back into the tape, each from a block boundary.
+// threads == 0 uses every hardware thread.
+// Stores the number of partitions in shardCount. Returns false when the sort could not
+// run or a partition could not be written back, whose records are then left in its
+// partition file.
+bool sample_sort(Tape* tape, size_t bufferNumber, size_t partitions, bool keepShards = false,
+                 size_t threads = 0, size_t* shardCount = nullptr);
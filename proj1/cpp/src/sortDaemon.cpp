@@ -0,0 +1,570 @@
+#include "sortDaemon.hpp"
+#include "tapeSort.hpp"
+#include "sampleSort.hpp"
+#include "pipeSort.hpp"
+#include "verify.hpp"
+#include "mergeKernel.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "logger.hpp"
+
+//==============================Scheduler==================================
+
+struct Grant {
+    size_t buffers = 0;
+    size_t threads = 0;
+};
+
+// Hands out buffers from one budget. Jobs start in arrival order and split the
+// free buffers and the hardware threads with the jobs running or waiting, so a
+// job alone gets nearly all of them. Every grant is at least the minimum and is
+// taken from the free buffers, so the grants never exceed the budget.
+class BufferScheduler {
+private:
+    std::mutex mutex;
+    std::condition_variable changed;
+    size_t budget, freeBuffers, maxJobs, hardwareThreads;
+    size_t running;
+    std::deque<size_t> waiting;
+
+public:
+    BufferScheduler(size_t totalBuffers, size_t jobs)
+        : budget(totalBuffers), freeBuffers(totalBuffers), maxJobs(jobs), running(0) {
+        hardwareThreads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+
+    Grant acquire(size_t jobId, size_t requested) {
+        std::unique_lock<std::mutex> lock(mutex);
+        waiting.push_back(jobId);
+
+        changed.wait(lock, [&]() {
+            return waiting.front() == jobId && running < maxJobs && freeBuffers >= DAEMON_MIN_JOB_BUFFERS;
+        });
+
+        // Free buffers are shared by the jobs that can start now. While job slots
+        // are left, a minimum share stays free so a later job can start at once.
+        size_t starting = std::min(maxJobs - running, waiting.size());
+        size_t available = freeBuffers;
+        if (running + starting < maxJobs && available >= 2 * DAEMON_MIN_JOB_BUFFERS) {
+            available -= DAEMON_MIN_JOB_BUFFERS;
+        }
+
+        Grant grant;
+        grant.buffers = std::max<size_t>(DAEMON_MIN_JOB_BUFFERS, available / starting);
+        if (requested != 0) grant.buffers = std::min(grant.buffers, std::max<size_t>(DAEMON_MIN_JOB_BUFFERS, requested));
+        grant.threads = std::max<size_t>(1, hardwareThreads / (running + starting));
+
+        waiting.pop_front();
+        freeBuffers -= grant.buffers;
+        running++;
+
+        // The next job in line may fit into what is left
+        changed.notify_all();
+        return grant;
+    }
+
+    void release(const Grant& grant) {
+        std::lock_guard<std::mutex> lock(mutex);
+        freeBuffers += grant.buffers;
+        running--;
+        changed.notify_all();
+    }
+
+    std::string describe() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::ostringstream line;
+        line << "buffers " << freeBuffers << "/" << budget << " free, "
+             << running << " running, " << waiting.size() << " waiting";
+        return line.str();
+    }
+};
+
+//==============================Jobs=======================================
+
+enum class JobState { QUEUED, LOADING, SORTING, VERIFYING, DONE, FAILED };
+
+static const char* state_name(JobState state) {
+    switch (state) {
+        case JobState::QUEUED:    return "queued";
+        case JobState::LOADING:   return "loading";
+        case JobState::SORTING:   return "sorting";
+        case JobState::VERIFYING: return "verifying";
+        case JobState::DONE:      return "done";
+        default:                  return "failed";
+    }
+}
+
+struct Job {
+    size_t id = 0;
+    std::string input, output;
+    std::string canonicalInput, canonicalOutput;
+    bool text = false;
+    bool check = false;
+    size_t requestedBuffers = 0;
+
+    std::atomic<JobState> state{JobState::QUEUED};
+    Grant grant;                    // set before the state leaves QUEUED
+    Counts::JobCounts counts;
+    std::atomic<size_t> expectedIo{0};
+
+    // Valid once the state is DONE or FAILED
+    size_t records = 0;
+    size_t blocks = 0;
+    double seconds = 0;
+    std::string error;
+
+    std::mutex mutex;
+    std::condition_variable finished;
+
+    bool is_over() const { return state == JobState::DONE || state == JobState::FAILED; }
+
+    // Estimated from the I/O a job of this size needs, stays below 100 until it is done
+    size_t percent() {
+        if (state == JobState::DONE) return 100;
+        size_t expected = expectedIo.load();
+        if (expected == 0) return 0;
+        size_t io = counts.readCount.load() + counts.writeCount.load();
+        return std::min<size_t>(99, 100 * io / expected);
+    }
+};
+
+static std::string job_line(Job& job) {
+    std::ostringstream line;
+    line << "JOB " << job.id << " " << state_name(job.state) << " " << job.input << " -> " << job.output;
+    if (job.state != JobState::QUEUED) {
+        line << " buffers=" << job.grant.buffers << " fan-in=" << job.grant.buffers - 1
+             << " threads=" << job.grant.threads << " progress=" << job.percent() << "%"
+             << " reads=" << job.counts.readCount << " writes=" << job.counts.writeCount;
+    }
+    return line.str();
+}
+
+// Block reads and writes of the sort itself, for progress only
+static size_t expected_sort_io(size_t blocks, const Grant& grant, bool sampleSort) {
+    if (sampleSort) return 4 * blocks;   // scatter pass, then sorting and writing back
+
+    size_t runs = (blocks + grant.buffers - 1) / grant.buffers;
+    size_t phases = 0;
+    if (runs > 1) phases = static_cast<size_t>(std::ceil(std::log(runs) / std::log(grant.buffers - 1)));
+    return 2 * blocks * (1 + phases);
+}
+
+static void fail(Job& job, const std::string& error) {
+    job.error = error;
+    job.state = JobState::FAILED;
+}
+
+static void run_job(Job& job, size_t blockSize) {
+    Counts::jobCounts = &job.counts;
+    job.state = JobState::LOADING;
+
+    FILE* textInput = nullptr;
+    std::unique_ptr<Tape> inputTape;
+    std::unique_ptr<RecordSource> source;
+    if (job.text) {
+        textInput = fopen(job.input.c_str(), "r");
+        if (textInput) source = std::make_unique<TextStreamSource>(textInput);
+    } else {
+        // Tapes drop a trailing partial block, the job would lose its records
+        std::error_code error;
+        uintmax_t inputSize = std::filesystem::file_size(job.input, error);
+        if (!error && inputSize % blockSize != 0) {
+            fail(job, "input ends with a partial block of " + std::to_string(inputSize % blockSize) + " bytes");
+            return;
+        }
+
+        inputTape = std::make_unique<Tape>(job.input, blockSize);
+        if (inputTape->open(std::ios::in)) {
+            size_t inputBlocks = inputTape->get_total_blocks();
+            job.expectedIo = 2 * inputBlocks;
+            source = std::make_unique<TapeSource>(*inputTape, 0, inputBlocks);
+        }
+    }
+    if (!source) {
+        fail(job, "cannot open input");
+        return;
+    }
+
+    // The sort works in place, so the input is first copied into the output tape
+    Tape tape(job.output, blockSize);
+    if (!tape.open(std::ios::in | std::ios::out | std::ios::trunc)) {
+        if (textInput) fclose(textInput);
+        fail(job, "cannot create output");
+        return;
+    }
+
+    // Checksum of the submitted input, so a check also covers the copy
+    uint64_t inputChecksum = 0;
+    TapeSink sink(tape);
+    RecordType record;
+    while (source->next(record)) {
+        if (record.get_timestamp() == 0) continue;
+        sink.write(record);
+        job.records++;
+        inputChecksum += record_checksum(record.get_timestamp());
+    }
+    sink.finish();
+    if (textInput) fclose(textInput);
+    if (inputTape) inputTape->close();
+
+    job.blocks = sink.get_blocks_written();
+    tape.close();
+
+    // Every partition sort needs 3 buffers of the grant
+    bool sampleSort = job.grant.threads > 1 && job.grant.buffers >= 3 * job.grant.threads;
+    size_t done = job.counts.readCount + job.counts.writeCount;
+    job.expectedIo = done + expected_sort_io(job.blocks, job.grant, sampleSort)
+                   + (job.check ? job.blocks : 0);
+    job.state = JobState::SORTING;
+
+    if (sampleSort) {
+        if (!sample_sort(&tape, job.grant.buffers, job.grant.threads, false, job.grant.threads)) {
+            fail(job, "sample sort failed");
+            return;
+        }
+    } else {
+        BufferPool pool(job.grant.buffers);
+        create_runs(&tape, job.grant.buffers, &pool);
+        merge(&tape, job.grant.buffers, nullptr, &pool);
+        tape.close();
+    }
+
+    if (job.check) {
+        job.state = JobState::VERIFYING;
+        VerifyResult outputCheck = verify_tape(job.output, blockSize, job.grant.threads);
+        if (!outputCheck.readable || !outputCheck.sorted || outputCheck.records != job.records
+            || outputCheck.checksum != inputChecksum) {
+            fail(job, "check failed");
+            return;
+        }
+    }
+    job.state = JobState::DONE;
+}
+
+//==============================Server=====================================
+
+static bool send_line(int fd, const std::string& line) {
+    std::string data = line + "\n";
+    size_t sent = 0;
+    while (sent < data.size()) {
+        // A client that went away must not kill the daemon with SIGPIPE
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        sent += n;
+    }
+    return true;
+}
+
+static bool read_line(int fd, std::string& line) {
+    line.clear();
+    char c;
+    while (recv(fd, &c, 1, 0) == 1) {
+        if (c == '\n') return true;
+        line += c;
+    }
+    return !line.empty();
+}
+
+static bool fill_address(const std::string& socketPath, sockaddr_un& address) {
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        Logger::log("Socket path %s is too long\n", socketPath.c_str());
+        return false;
+    }
+    strcpy(address.sun_path, socketPath.c_str());
+    return true;
+}
+
+class SortDaemon {
+private:
+    size_t blockSize;
+    BufferScheduler scheduler;
+    int listenFd;
+    std::atomic<bool> stopping{false};
+
+    // Connection threads are detached, shutdown waits for the count to drop to 0
+    std::mutex connectionsMutex;
+    std::condition_variable connectionClosed;
+    size_t openConnections = 0;
+
+    std::mutex jobsMutex;
+    std::map<size_t, std::shared_ptr<Job>> jobs;
+    size_t nextJobId = 1;
+
+    // Totals over all finished jobs, for aggregate throughput
+    std::chrono::steady_clock::time_point started;
+    std::atomic<size_t> sortedBlocks{0};
+
+public:
+    SortDaemon(size_t block, size_t totalBuffers, size_t maxJobs)
+        : blockSize(block), scheduler(totalBuffers, maxJobs), listenFd(-1),
+          started(std::chrono::steady_clock::now()) {}
+
+    int serve(const std::string& socketPath);
+
+private:
+    void handle_connection(int fd);
+    void handle_sort(int fd, std::istringstream& request);
+    void handle_status(int fd);
+};
+
+int SortDaemon::serve(const std::string& socketPath) {
+    sockaddr_un address;
+    if (!fill_address(socketPath, address)) return 1;
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socketPath.c_str());
+    if (listenFd < 0 || bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0
+        || listen(listenFd, 16) < 0) {
+        Logger::log("Cannot listen on %s: %s\n", socketPath.c_str(), strerror(errno));
+        if (listenFd >= 0) close(listenFd);
+        return 1;
+    }
+    Logger::log("Sort daemon listening on %s, %s\n", socketPath.c_str(), scheduler.describe().c_str());
+
+    while (!stopping) {
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            if (stopping || errno != EINTR) break;
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(connectionsMutex);
+            openConnections++;
+        }
+        std::thread([this, fd]() {
+            handle_connection(fd);
+            close(fd);
+            std::lock_guard<std::mutex> lock(connectionsMutex);
+            openConnections--;
+            connectionClosed.notify_all();
+        }).detach();
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(connectionsMutex);
+        connectionClosed.wait(lock, [this]() { return openConnections == 0; });
+    }
+    close(listenFd);
+    unlink(socketPath.c_str());
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    Logger::log("Sort daemon stopped after %zu jobs, %.1f MB sorted at %.1f MB/s overall\n",
+                nextJobId - 1, sortedBlocks * blockSize / (1024.0 * 1024.0),
+                seconds > 0 ? sortedBlocks * blockSize / seconds / (1024.0 * 1024.0) : 0.0);
+    return 0;
+}
+
+void SortDaemon::handle_connection(int fd) {
+    std::string line;
+    if (!read_line(fd, line)) return;
+
+    std::istringstream request(line);
+    std::string command;
+    request >> command;
+
+    if (command == "SORT") {
+        // A bad request must not take the daemon and its other jobs down
+        try {
+            handle_sort(fd, request);
+        } catch (const std::exception& e) {
+            send_line(fd, std::string("FAILED ") + e.what());
+        }
+    }
+    else if (command == "STATUS") handle_status(fd);
+    else if (command == "SHUTDOWN") {
+        stopping = true;
+        // Wakes the accept() of the serving thread
+        shutdown(listenFd, SHUT_RDWR);
+        send_line(fd, "OK shutting down");
+    } else {
+        send_line(fd, "ERROR unknown request " + command);
+    }
+}
+
+void SortDaemon::handle_status(int fd) {
+    std::vector<std::shared_ptr<Job>> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        for (auto& entry : jobs) snapshot.push_back(entry.second);
+    }
+    send_line(fd, "DAEMON " + scheduler.describe());
+    for (auto& job : snapshot) send_line(fd, job_line(*job));
+    send_line(fd, "END");
+}
+
+void SortDaemon::handle_sort(int fd, std::istringstream& request) {
+    auto job = std::make_shared<Job>();
+    request >> job->input >> job->output;
+
+    std::string option;
+    while (request >> option) {
+        if (option == "txt") job->text = true;
+        else if (option == "check") job->check = true;
+        else if (option.rfind("buffers=", 0) == 0) {
+            const char* value = option.c_str() + 8;
+            char* end = nullptr;
+            unsigned long buffers = strtoul(value, &end, 10);
+            if (*value < '0' || *value > '9' || *end != '\0' || buffers == 0) {
+                send_line(fd, "FAILED bad buffers value");
+                return;
+            }
+            job->requestedBuffers = buffers;
+        }
+        else {
+            send_line(fd, "FAILED unknown option " + option);
+            return;
+        }
+    }
+    if (job->input.empty() || job->output.empty() || job->input[0] != '/' || job->output[0] != '/') {
+        send_line(fd, "FAILED SORT needs absolute input and output paths");
+        return;
+    }
+
+    // Compared as canonical paths, the output tape is truncated before the input is read
+    std::error_code error;
+    std::string input = std::filesystem::weakly_canonical(job->input, error).string();
+    std::string output = std::filesystem::weakly_canonical(job->output, error).string();
+    if (error || input == output) {
+        send_line(fd, "FAILED input and output must be different files");
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        // Temp files are named after the output, two jobs on it would clash, and
+        // no job may write a file another one is still reading
+        for (auto& entry : jobs) {
+            const Job& other = *entry.second;
+            if (other.is_over()) continue;
+            if (other.canonicalOutput == output || other.canonicalOutput == input) {
+                send_line(fd, "FAILED " + other.output + " is the output of running job "
+                              + std::to_string(entry.first));
+                return;
+            }
+            if (other.canonicalInput == output) {
+                send_line(fd, "FAILED " + other.input + " is the input of running job "
+                              + std::to_string(entry.first));
+                return;
+            }
+        }
+        job->canonicalInput = input;
+        job->canonicalOutput = output;
+        job->id = nextJobId++;
+        jobs[job->id] = job;
+    }
+    send_line(fd, "QUEUED " + std::to_string(job->id));
+
+    std::thread runner([this, job]() {
+        job->grant = scheduler.acquire(job->id, job->requestedBuffers);
+        auto start = std::chrono::steady_clock::now();
+        run_job(*job, blockSize);
+        job->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        scheduler.release(job->grant);
+
+        if (job->state == JobState::DONE) sortedBlocks += job->blocks;
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->finished.notify_all();
+    });
+
+    // Reports until the job is over, the job keeps running if the client leaves
+    bool clientGone = false;
+    bool started = false;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(job->mutex);
+            job->finished.wait_for(lock, std::chrono::milliseconds(DAEMON_PROGRESS_MS),
+                                   [&]() { return job->is_over(); });
+        }
+        if (job->is_over()) break;
+        if (clientGone || job->state == JobState::QUEUED) continue;
+
+        if (!started) {
+            started = true;
+            clientGone = !send_line(fd, "STARTED " + std::to_string(job->id)
+                                        + " buffers=" + std::to_string(job->grant.buffers)
+                                        + " fan-in=" + std::to_string(job->grant.buffers - 1)
+                                        + " threads=" + std::to_string(job->grant.threads));
+        }
+        if (!clientGone) {
+            clientGone = !send_line(fd, "PROGRESS " + std::to_string(job->id) + " "
+                                        + state_name(job->state) + " " + std::to_string(job->percent()) + "%");
+        }
+    }
+    runner.join();
+
+    std::ostringstream result;
+    if (job->state == JobState::DONE) {
+        double megabytes = job->blocks * blockSize / (1024.0 * 1024.0);
+        result << "DONE " << job->id << " records=" << job->records << " blocks=" << job->blocks
+               << " buffers=" << job->grant.buffers << " threads=" << job->grant.threads
+               << " reads=" << job->counts.readCount << " writes=" << job->counts.writeCount
+               << " time=" << static_cast<size_t>(job->seconds * 1000) << "ms"
+               << " throughput=" << (job->seconds > 0 ? megabytes / job->seconds : 0.0) << "MB/s";
+    } else {
+        result << "FAILED " << job->id << " " << job->error;
+    }
+    Logger::log("%s\n", result.str().c_str());
+    if (!clientGone) send_line(fd, result.str());
+}
+
+int run_daemon(const std::string& socketPath, size_t blockSize, size_t totalBuffers, size_t maxJobs) {
+    if (totalBuffers < DAEMON_MIN_JOB_BUFFERS) {
+        Logger::log("The daemon needs a budget of at least %d buffers\n", DAEMON_MIN_JOB_BUFFERS);
+        return 1;
+    }
+    if (maxJobs == 0) maxJobs = std::max<size_t>(1, std::thread::hardware_concurrency());
+
+    // Kernel choice is lazy, make it before concurrent jobs race for it
+    get_merge_kernel();
+
+    SortDaemon daemon(blockSize, totalBuffers, maxJobs);
+    return daemon.serve(socketPath);
+}
+
+//==============================Client=====================================
+
+int send_daemon_request(const std::string& socketPath, const std::string& request) {
+    sockaddr_un address;
+    if (!fill_address(socketPath, address)) return 1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        Logger::log("Cannot connect to %s: %s\n", socketPath.c_str(), strerror(errno));
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+
+    if (!send_line(fd, request)) {
+        close(fd);
+        return 1;
+    }
+
+    std::string line, last;
+    while (read_line(fd, line)) {
+        Logger::log("%s\n", line.c_str());
+        last = line;
+    }
+    close(fd);
+
+    bool failed = last.empty() || last.rfind("FAILED", 0) == 0 || last.rfind("ERROR", 0) == 0;
+    return failed ? 1 : 0;
+}
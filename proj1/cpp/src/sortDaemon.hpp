@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+
+// Fewest buffers a job is started with, merge() needs 2 inputs and an output
+#define DAEMON_MIN_JOB_BUFFERS 3
+// How often a waiting client is sent the progress of its job
+#define DAEMON_PROGRESS_MS 500
+
+// Serves sort jobs on a Unix domain socket until a SHUTDOWN request.
+// Every request is one line, paths must be absolute and without spaces:
+//   SORT <input> <output> [txt] [buffers=N] [check]
+//       Sorts a binary tape, or a text file with txt, into output. buffers caps the
+//       job's share of the budget, check verifies the result like --check.
+//       Binary inputs must be whole blocks, input and output different files.
+//       Replies QUEUED, STARTED, PROGRESS lines and finally DONE or FAILED.
+//   STATUS      One line per job, then END
+//   SHUTDOWN    Stops accepting requests, lets accepted jobs finish and exits
+// Jobs share totalBuffers blocks of blockSize bytes, at most maxJobs run at once.
+// A job's buffers, fan-in and threads come from splitting what is free between the
+// jobs running or waiting when it starts, never less than DAEMON_MIN_JOB_BUFFERS.
+int run_daemon(const std::string& socketPath, size_t blockSize, size_t totalBuffers, size_t maxJobs);
+
+// Sends one request and logs the replies, returns 0 when the request succeeded
+int send_daemon_request(const std::string& socketPath, const std::string& request);
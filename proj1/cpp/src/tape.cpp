@@ -1,8 +1,11 @@
 #include "tape.hpp"
+#include <cstdlib>
+#include <unistd.h>
 #include "logger.hpp"
 
 namespace Counts{
-    size_t totalReadCount = 0, totalWriteCount = 0;
+    std::atomic<size_t> totalReadCount{0}, totalWriteCount{0};
+    thread_local JobCounts* jobCounts = nullptr;
 }
 
 
@@ -33,6 +36,7 @@ void Tape::write_block(size_t blockNum, RecordType* records, size_t recordCount)
     }
     writeCount++;
     Counts::totalWriteCount++;
+    if (Counts::jobCounts) Counts::jobCounts->writeCount++;
 }
 
 bool Tape::read_block(size_t blockNum, std::vector<RecordType>& buffer) {
@@ -51,6 +55,7 @@ bool Tape::read_block(size_t blockNum, std::vector<RecordType>& buffer) {
     }
     readCount++;
     Counts::totalReadCount++;
+    if (Counts::jobCounts) Counts::jobCounts->readCount++;
     return true;
 }
 
@@ -223,7 +228,10 @@ void Tape::load_records_from_keyboard() {
 
 
 void Tape::display_block(size_t block) {
-    std::ifstream in(filename, std::ios::binary);
+    // Reuse the open stream instead of reopening the file for every call
+    std::ifstream own;
+    std::istream& in = file.is_open() ? static_cast<std::istream&>(file) : own;
+    if (!file.is_open()) own.open(filename, std::ios::binary);
     in.seekg(block * blockSize, std::ios::beg);
 
     for (size_t i = 0; i < numOfRecordInBlock; ++i) {
@@ -233,11 +241,15 @@ void Tape::display_block(size_t block) {
         else Logger::log("%d ", value);
     }
     Logger::log("\n");
-    in.close();
+    in.clear();
 }
 
 void Tape::display() {
-    std::ifstream in(filename, std::ios::binary);
+    std::ifstream own;
+    std::istream& in = file.is_open() ? static_cast<std::istream&>(file) : own;
+    if (!file.is_open()) own.open(filename, std::ios::binary);
+    in.seekg(0, std::ios::beg);
+
     time_record_type value;
     size_t count = 0;
 
@@ -249,11 +261,18 @@ void Tape::display() {
         if (count % numOfRecordInBlock == 0) Logger::log_verbose("| ");
     }
     Logger::log_verbose("\n");
-    in.close();
+    in.clear();
 }
 
 size_t Tape::get_total_blocks() {
+    if (file.is_open()) {
+        file.seekg(0, std::ios::end);
+        size_t fileSize = static_cast<size_t>(file.tellg());
+        return fileSize / blockSize;
+    }
+
     std::ifstream in(filename, std::ios::binary | std::ios::ate);
+    if (!in.is_open()) return 0;
     size_t fileSize = static_cast<size_t>(in.tellg());
     in.close();
     return fileSize / blockSize;
@@ -264,3 +283,13 @@ size_t Tape::get_write_count() const { return writeCount; }
 size_t Tape::get_block_size() const { return blockSize; }
 size_t Tape::get_num_of_record_in_block() const { return numOfRecordInBlock; }
 std::string Tape::get_filename() const { return filename; }
+
+std::string create_scratch_file(const std::string& prefix) {
+    const char* dir = std::getenv("TMPDIR");
+    std::string name = std::string(dir && *dir ? dir : "/tmp") + "/" + prefix + "XXXXXX";
+
+    int fd = mkstemp(&name[0]);
+    if (fd < 0) return "";
+    ::close(fd);
+    return name;
+}
@@ -4,11 +4,18 @@
 #include <vector>
 #include <string>
 #include <random>
+#include <atomic>
 
 #include "recordType.hpp"
 
 namespace Counts{
-    extern size_t totalReadCount, totalWriteCount;
+    extern std::atomic<size_t> totalReadCount, totalWriteCount;
+
+    // Block I/O of one daemon job, its threads point jobCounts at it
+    struct JobCounts {
+        std::atomic<size_t> readCount{0}, writeCount{0};
+    };
+    extern thread_local JobCounts* jobCounts;
 }
 
 
@@ -45,3 +52,7 @@ public:
     size_t get_num_of_record_in_block() const;
     std::string get_filename() const;
 };
+
+// Creates an empty file with a unique name under $TMPDIR (or /tmp) for a scratch
+// tape, returns its name or an empty string when it cannot be created
+std::string create_scratch_file(const std::string& prefix);
@@ -1,22 +1,99 @@
 #include "tapeSort.hpp"
 #include "tape.hpp"
 #include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <ctime>
+#include <iterator>
+#include <memory>
 #include <queue>
+#include <type_traits>
+#include "mergeKernel.hpp"
 #include "logger.hpp"
 
-size_t totalPhases = 0;
+// Partitions of a sample sort are merged concurrently
+std::atomic<size_t> totalPhases{0};
+std::atomic<std::clock_t> totalMergeCpu{0};
+
+// Records are handed to the merge kernel as plain keys
+static_assert(sizeof(RecordType) == sizeof(time_record_type) && std::is_standard_layout<RecordType>::value,
+              "RecordType must have the layout of time_record_type");
+
+// Random access over the records of pinned frames that are all full except the
+// last one, so a run is sorted in the frames it was read into
+class FrameIterator {
+private:
+    std::vector<RecordType>* const* frames;
+    std::ptrdiff_t perFrame;
+    std::ptrdiff_t index;
+
+public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = RecordType;
+    using difference_type = std::ptrdiff_t;
+    using pointer = RecordType*;
+    using reference = RecordType&;
+
+    FrameIterator() : frames(nullptr), perFrame(1), index(0) {}
+    FrameIterator(std::vector<RecordType>* const* f, size_t recordsPerFrame, difference_type i)
+        : frames(f), perFrame(static_cast<difference_type>(recordsPerFrame)), index(i) {}
+
+    reference operator*() const { return (*frames[index / perFrame])[index % perFrame]; }
+    pointer operator->() const { return &**this; }
+    reference operator[](difference_type n) const { return *(*this + n); }
+
+    FrameIterator& operator++() { ++index; return *this; }
+    FrameIterator& operator--() { --index; return *this; }
+    FrameIterator operator++(int) { FrameIterator old = *this; ++index; return old; }
+    FrameIterator operator--(int) { FrameIterator old = *this; --index; return old; }
+    FrameIterator& operator+=(difference_type n) { index += n; return *this; }
+    FrameIterator& operator-=(difference_type n) { index -= n; return *this; }
+    FrameIterator operator+(difference_type n) const { return FrameIterator(frames, perFrame, index + n); }
+    FrameIterator operator-(difference_type n) const { return FrameIterator(frames, perFrame, index - n); }
+    friend FrameIterator operator+(difference_type n, const FrameIterator& it) { return it + n; }
+    difference_type operator-(const FrameIterator& other) const { return index - other.index; }
+
+    bool operator==(const FrameIterator& other) const { return index == other.index; }
+    bool operator!=(const FrameIterator& other) const { return index != other.index; }
+    bool operator<(const FrameIterator& other) const { return index < other.index; }
+    bool operator>(const FrameIterator& other) const { return index > other.index; }
+    bool operator<=(const FrameIterator& other) const { return index <= other.index; }
+    bool operator>=(const FrameIterator& other) const { return index >= other.index; }
+};
+
+// Moves records from the back frames into gaps of the front ones (blocks with
+// padding), afterwards only the last non-empty frame may be partly filled
+static size_t fill_frames(std::vector<std::vector<RecordType>*>& frames, size_t recordsPerBlock) {
+    size_t front = 0, back = frames.size();
+    while (back > 0 && frames[back - 1]->empty()) back--;
+
+    while (front + 1 < back) {
+        if (frames[front]->size() >= recordsPerBlock) {
+            front++;
+        } else {
+            frames[front]->push_back(frames[back - 1]->back());
+            frames[back - 1]->pop_back();
+            while (back > 0 && frames[back - 1]->empty()) back--;
+        }
+    }
 
-void create_runs(Tape *tape, size_t bufferNumber) {
+    size_t total = 0;
+    for (const std::vector<RecordType>* frame : frames) total += frame->size();
+    return total;
+}
+
+void create_runs(Tape *tape, size_t bufferNumber, BufferPool* pool) {
     if (!tape) return;
 
-    size_t totalBlocks = tape->get_total_blocks();
-    size_t recordsPerBlock = tape->get_num_of_record_in_block();
+    std::unique_ptr<BufferPool> ownPool;
+    if (!pool) {
+        ownPool = std::make_unique<BufferPool>(bufferNumber);
+        pool = ownPool.get();
+    }
 
-    std::vector<RecordType> buffer;
-    buffer.reserve(bufferNumber * recordsPerBlock);
+    size_t recordsPerBlock = tape->get_num_of_record_in_block();
 
     size_t currentBlock = 0;
-    size_t runIndex = 0;
 
 
     Logger::log_verbose("Creating runs...\n");
@@ -26,49 +103,52 @@ void create_runs(Tape *tape, size_t bufferNumber) {
             return;
     }
 
-    while (currentBlock < totalBlocks) {
-        buffer.clear();
+    size_t totalBlocks = tape->get_total_blocks();
 
-        // Read up to bufferNumber blocks into memory
+    while (currentBlock < totalBlocks) {
+        // Pin up to bufferNumber blocks, the run is sorted inside them without a copy
+        std::vector<size_t> runBlocks;
+        std::vector<std::vector<RecordType>*> runFrames;
         for (size_t i = 0; i < bufferNumber && currentBlock < totalBlocks; ++i, ++currentBlock) {
-            std::vector<RecordType> tmp;
-            if (!tape->read_block(currentBlock, tmp)) break;
-            buffer.insert(buffer.end(), tmp.begin(), tmp.end());
+            std::vector<RecordType>* frame = pool->pin(tape, currentBlock);
+            if (!frame) break;
+            runBlocks.push_back(currentBlock);
+            runFrames.push_back(frame);
         }
 
-        if (buffer.empty()) break;
+        if (runFrames.empty()) break;
 
         // Sort records in memory
-        std::sort(buffer.begin(), buffer.end(), [](const RecordType& a, const RecordType& b) {
+        size_t totalRecords = fill_frames(runFrames, recordsPerBlock);
+        FrameIterator first(runFrames.data(), recordsPerBlock, 0);
+        std::sort(first, first + totalRecords, [](const RecordType& a, const RecordType& b) {
             return a.get_timestamp() < b.get_timestamp();
         });
 
-        // Write sorted run back to the same region
-        size_t totalRecords = buffer.size();
-        size_t blocksNeeded = (totalRecords + recordsPerBlock - 1) / recordsPerBlock;
-
-        RecordType* ptr = buffer.data();
-        for (size_t b = 0; b < blocksNeeded; ++b) {
-            size_t offset = b * recordsPerBlock;
-            size_t remaining = totalRecords - offset;
-            size_t count = std::min(remaining, recordsPerBlock);
-            tape->write_block(runIndex * bufferNumber + b, ptr + offset, count);
-        }
-
         Logger::log_verbose("| ");
-        for(RecordType record : buffer){
-            Logger::log_verbose("%d ", record.get_timestamp());
+        for (size_t b = 0; b < runFrames.size(); ++b) {
+            for (const RecordType& record : *runFrames[b]) {
+                Logger::log_verbose("%d ", record.get_timestamp());
+            }
         }
         Logger::log_verbose("|\n");
 
-        runIndex++;
+        // Frames are written back on eviction
+        for (size_t b = 0; b < runFrames.size(); ++b) pool->unpin(tape, runBlocks[b], true);
     }
     Logger::log_verbose("\n");
 
+    pool->flush(tape);
     tape->close();
 }
 
-void merge(Tape* tape, size_t bufferNumber) {
+void merge(Tape* tape, size_t bufferNumber, AggregatePipeline* pipeline, BufferPool* pool) {
+    std::unique_ptr<BufferPool> ownPool;
+    if (!pool) {
+        ownPool = std::make_unique<BufferPool>(bufferNumber);
+        pool = ownPool.get();
+    }
+
     if (!tape->open(std::ios::in | std::ios::out)) {
             Logger::log("Failed to reopen tape!\n");
             return;
@@ -87,7 +167,10 @@ void merge(Tape* tape, size_t bufferNumber) {
     // Calculate number of initial runs
     size_t numRuns = (totalBlocks + initialRunSize - 1) / initialRunSize;
 
-    if (numRuns <= 1) {
+    // A sorted tape still needs one pass to feed the pipeline
+    bool pipelineDone = (pipeline == nullptr || pipeline->empty());
+
+    if (numRuns <= 1 && pipelineDone) {
         Logger::log_verbose("File already sorted (only 1 run exists)\n\n");
         return;
     }
@@ -97,9 +180,22 @@ void merge(Tape* tape, size_t bufferNumber) {
     int phase = 1;
 
     // Create temporary tape for output
-    Tape* outputTape = new Tape("temp_merge.bin", tape->get_block_size());
+    // Named after the tape so that several tapes can be merged at the same time
+    std::string outputName = tape->get_filename() + ".merge.tmp";
+    Tape* outputTape = new Tape(outputName, tape->get_block_size());
+
+    // nullptr selects the heap for every group
+    MergeKernel kernel = get_merge_kernel();
+    // Kernel groups pin two scratch frames besides their inputs and output,
+    // groups that do not fit in the pool use the heap
+    size_t frameCount = pool->get_frame_count();
+    size_t kernelFanIn = kernel && frameCount > 3 ? std::min<size_t>(SMALL_FAN_IN, frameCount - 3) : 0;
+
+    while (numRuns > 1 || !pipelineDone) {
+        bool finalPhase = numRuns <= mergeWays;
+        std::clock_t phaseCpu = 0;    // merging only, without block I/O and verbose display
+        std::clock_t poolCpu = 0;     // pins of the current group, they may read or write blocks
 
-    while (numRuns > 1) {
         Logger::log_verbose("\n========== Merge Phase %d ==========\n", phase);
         Logger::log_verbose("Merging %zu runs of size %zu blocks\n",
                     numRuns, currentRunSize);
@@ -118,6 +214,10 @@ void merge(Tape* tape, size_t bufferNumber) {
         while (runsProcessed < numRuns) {
             size_t runsInThisGroup = std::min(mergeWays, numRuns - runsProcessed);
 
+            // Merged runs keep the layout of the next phase even when padding made
+            // them shorter, the blocks in between read as padding
+            outputBlockNum = runsProcessed * currentRunSize;
+
             Logger::log_verbose("\nMerging runs %zu to %zu: ", runsProcessed,
                         runsProcessed + runsInThisGroup - 1);
 
@@ -127,10 +227,34 @@ void merge(Tape* tape, size_t bufferNumber) {
                 size_t startBlock;
                 size_t endBlock;
                 size_t currentBlock;
-                std::vector<RecordType> buffer;
+                std::vector<RecordType>* buffer;    // pinned frame, nullptr once the run is exhausted
+                size_t pinnedBlock;
                 size_t bufferPos;
             };
 
+            // Pins through the pool, timed so that its I/O stays out of the merge CPU
+            auto pin_block = [&](Tape* t, size_t blockNum, bool load) {
+                std::clock_t start = std::clock();
+                std::vector<RecordType>* records = pool->pin(t, blockNum, load);
+                poolCpu += std::clock() - start;
+                return records;
+            };
+
+            // Unpins the consumed block and pins the next non-empty one of the run
+            auto advance = [&](RunInfo& run) {
+                if (run.buffer) pool->unpin(tape, run.pinnedBlock, false);
+                run.buffer = nullptr;
+                run.bufferPos = 0;
+
+                while (run.currentBlock < run.endBlock) {
+                    run.pinnedBlock = run.currentBlock++;
+                    run.buffer = pin_block(tape, run.pinnedBlock, true);
+                    if (run.buffer && !run.buffer->empty()) return;
+                    if (run.buffer) pool->unpin(tape, run.pinnedBlock, false);
+                    run.buffer = nullptr;
+                }
+            };
+
             std::vector<RunInfo> runs(runsInThisGroup);
 
             // Initialize run information
@@ -139,69 +263,217 @@ void merge(Tape* tape, size_t bufferNumber) {
                 runs[i].startBlock = runs[i].runIndex * currentRunSize;
                 runs[i].endBlock = std::min(runs[i].startBlock + currentRunSize, totalBlocks);
                 runs[i].currentBlock = runs[i].startBlock;
+                runs[i].buffer = nullptr;
                 runs[i].bufferPos = 0;
 
                 // Load first block of this run
-                tape->read_block(runs[i].currentBlock, runs[i].buffer);
-                runs[i].currentBlock++;
+                advance(runs[i]);
             }
 
-            // Min-heap: pair of (RecordType, runIndex)
-            auto cmp = [](const std::pair<RecordType, size_t>& a, const std::pair<RecordType, size_t>& b) {
-                return a.first.get_timestamp() > b.first.get_timestamp();
-            };
-            
-            std::priority_queue<std::pair<RecordType, size_t>, 
-                              std::vector<std::pair<RecordType, size_t>>, 
-                              decltype(cmp)> minHeap(cmp);
-            // Initialize heap with first record from each run
-            for (size_t i = 0; i < runsInThisGroup; ++i) {
-                if (!runs[i].buffer.empty()) {
-                    minHeap.push({runs[i].buffer[runs[i].bufferPos], i});
-                    runs[i].bufferPos++;
-                }
-            }
-
-            // Output buffer and track merged records for display
-            std::vector<RecordType> outputBuffer;
-            outputBuffer.reserve(recordsPerBlock);
+            // Output block is a pool frame too, pinned only while records are added to it
+            std::vector<RecordType>* outputBuffer = nullptr;
             std::vector<RecordType> mergedRun; // For displaying this merged run
 
-            // Merge process
-            while (!minHeap.empty()) {
-                auto [minRecord, runIdx] = minHeap.top();
-                minHeap.pop();
+            // Passes a merged record to the output block, false when no frame is left
+            auto emit = [&](const RecordType& record) {
+                // Aggregation runs on the final sorted stream instead of a separate pass
+                bool keep = !(finalPhase && !pipelineDone) || pipeline->push(record);
 
                 // Add to output buffer
-                outputBuffer.push_back(minRecord);
-                mergedRun.push_back(minRecord);
+                if (keep) {
+                    if (!outputBuffer) {
+                        outputBuffer = pin_block(outputTape, outputBlockNum, false);
+                        if (!outputBuffer) return false;
+                    }
+                    outputBuffer->push_back(record);
+                    if (Logger::verbose) mergedRun.push_back(record);
+                }
 
-                // If output buffer is full, write it
-                if (outputBuffer.size() >= recordsPerBlock) {
-                    outputTape->write_block(outputBlockNum++, outputBuffer.data(), outputBuffer.size());
-                    outputBuffer.clear();
+                // If output buffer is full, leave it to the pool to write
+                if (outputBuffer && outputBuffer->size() >= recordsPerBlock) {
+                    pool->unpin(outputTape, outputBlockNum++, true);
+                    outputBuffer = nullptr;
                 }
+                return true;
+            };
 
-                // Refill the run buffer if needed
-                if (runs[runIdx].bufferPos >= runs[runIdx].buffer.size()) {
-                    if (runs[runIdx].currentBlock < runs[runIdx].endBlock) {
-                        runs[runIdx].buffer.clear();
-                        tape->read_block(runs[runIdx].currentBlock, runs[runIdx].buffer);
-                        runs[runIdx].currentBlock++;
-                        runs[runIdx].bufferPos = 0;
+            // Same for a sorted span, copied block by block when no pipeline looks at it
+            auto emit_range = [&](const RecordType* records, size_t count) {
+                if (finalPhase && !pipelineDone) {
+                    for (size_t i = 0; i < count; ++i) {
+                        if (!emit(records[i])) return false;
                     }
+                    return true;
                 }
+                if (Logger::verbose) mergedRun.insert(mergedRun.end(), records, records + count);
 
-                // Add next record from same run to heap
-                if (runs[runIdx].bufferPos < runs[runIdx].buffer.size()) {
-                    minHeap.push({runs[runIdx].buffer[runs[runIdx].bufferPos], runIdx});
-                    runs[runIdx].bufferPos++;
+                while (count > 0) {
+                    if (!outputBuffer) {
+                        outputBuffer = pin_block(outputTape, outputBlockNum, false);
+                        if (!outputBuffer) return false;
+                    }
+                    size_t n = std::min(count, recordsPerBlock - outputBuffer->size());
+                    outputBuffer->insert(outputBuffer->end(), records, records + n);
+                    records += n;
+                    count -= n;
+
+                    if (outputBuffer->size() >= recordsPerBlock) {
+                        pool->unpin(outputTape, outputBlockNum++, true);
+                        outputBuffer = nullptr;
+                    }
+                }
+                return true;
+            };
+
+            poolCpu = 0;
+            std::clock_t groupStart = std::clock();
+
+            if (runsInThisGroup <= kernelFanIn) {
+                // Block merge: the records up to the smallest last record of the current
+                // blocks can be merged at once. A round takes at most one block of them,
+                // so both scratch arrays are single frames pinned from the pool.
+                std::vector<RecordType>* scratch[2] = {pool->pin_scratch(), pool->pin_scratch()};
+                if (!scratch[0] || !scratch[1]) {
+                    if (scratch[0]) pool->unpin_scratch(scratch[0]);
+                    delete outputTape;
+                    return;
+                }
+                time_record_type* merged[2];
+                for (int s = 0; s < 2; ++s) {
+                    scratch[s]->resize(recordsPerBlock);
+                    merged[s] = reinterpret_cast<time_record_type*>(scratch[s]->data());
+                }
+
+                const time_record_type* heads[SMALL_FAN_IN];
+                const time_record_type* ends[SMALL_FAN_IN];
+                size_t counts[SMALL_FAN_IN];
+
+                // Records of every run not greater than key, per run in counts
+                auto count_upto = [&](time_record_type key) {
+                    size_t total = 0;
+                    for (size_t i = 0; i < runsInThisGroup; ++i) {
+                        counts[i] = heads[i] ? std::upper_bound(heads[i], ends[i], key) - heads[i] : 0;
+                        total += counts[i];
+                    }
+                    return total;
+                };
+
+                while (true) {
+                    bool anyRun = false;
+                    time_record_type bound = 0;
+                    time_record_type smallest = 0;
+                    for (size_t i = 0; i < runsInThisGroup; ++i) {
+                        const RunInfo& run = runs[i];
+                        heads[i] = ends[i] = nullptr;
+                        if (!run.buffer) continue;
+                        heads[i] = reinterpret_cast<const time_record_type*>(run.buffer->data()) + run.bufferPos;
+                        ends[i] = reinterpret_cast<const time_record_type*>(run.buffer->data() + run.buffer->size());
+                        time_record_type last = ends[i][-1];
+                        bound = anyRun ? std::min(bound, last) : last;
+                        smallest = anyRun ? std::min(smallest, *heads[i]) : *heads[i];
+                        anyRun = true;
+                    }
+                    if (!anyRun) break;
+
+                    if (count_upto(bound) > recordsPerBlock) {
+                        if (count_upto(smallest) > recordsPerBlock) {
+                            // More than a block of the smallest key, any block of them will do
+                            size_t left = recordsPerBlock;
+                            for (size_t i = 0; i < runsInThisGroup; ++i) {
+                                counts[i] = std::min(counts[i], left);
+                                left -= counts[i];
+                            }
+                        } else {
+                            // Largest key whose records still fit in one block
+                            time_record_type low = smallest, high = bound;
+                            while (high - low > 1) {
+                                time_record_type middle = low + (high - low) / 2;
+                                if (count_upto(middle) <= recordsPerBlock) low = middle;
+                                else high = middle;
+                            }
+                            count_upto(low);
+                        }
+                    }
+
+                    const time_record_type* mergedData = nullptr;
+                    size_t mergedCount = 0;
+                    int target = 0;
+
+                    for (size_t i = 0; i < runsInThisGroup; ++i) {
+                        RunInfo& run = runs[i];
+                        if (!run.buffer) continue;
+                        const time_record_type* begin = heads[i];
+                        size_t count = counts[i];
+
+                        if (!mergedData) {
+                            mergedData = begin;
+                        } else {
+                            kernel(mergedData, mergedCount, begin, count, merged[target]);
+                            mergedData = merged[target];
+                            target ^= 1;
+                        }
+                        mergedCount += count;
+                        run.bufferPos += count;
+                    }
+
+                    if (!emit_range(reinterpret_cast<const RecordType*>(mergedData), mergedCount)) {
+                        pool->unpin_scratch(scratch[0]);
+                        pool->unpin_scratch(scratch[1]);
+                        delete outputTape;
+                        return;
+                    }
+
+                    for (RunInfo& run : runs) {
+                        if (run.buffer && run.bufferPos >= run.buffer->size()) advance(run);
+                    }
+                }
+                pool->unpin_scratch(scratch[0]);
+                pool->unpin_scratch(scratch[1]);
+            } else {
+                // Min-heap: pair of (RecordType, runIndex)
+                auto cmp = [](const std::pair<RecordType, size_t>& a, const std::pair<RecordType, size_t>& b) {
+                    return a.first.get_timestamp() > b.first.get_timestamp();
+                };
+
+                std::priority_queue<std::pair<RecordType, size_t>,
+                                  std::vector<std::pair<RecordType, size_t>>,
+                                  decltype(cmp)> minHeap(cmp);
+                // Initialize heap with first record from each run
+                for (size_t i = 0; i < runsInThisGroup; ++i) {
+                    if (runs[i].buffer) {
+                        minHeap.push({(*runs[i].buffer)[runs[i].bufferPos], i});
+                        runs[i].bufferPos++;
+                    }
+                }
+
+                // Merge process
+                while (!minHeap.empty()) {
+                    auto [minRecord, runIdx] = minHeap.top();
+                    minHeap.pop();
+
+                    if (!emit(minRecord)) {
+                        delete outputTape;
+                        return;
+                    }
+
+                    // Refill the run buffer if needed
+                    if (runs[runIdx].bufferPos >= runs[runIdx].buffer->size()) {
+                        advance(runs[runIdx]);
+                    }
+
+                    // Add next record from same run to heap
+                    if (runs[runIdx].buffer) {
+                        minHeap.push({(*runs[runIdx].buffer)[runs[runIdx].bufferPos], runIdx});
+                        runs[runIdx].bufferPos++;
+                    }
                 }
             }
 
+            phaseCpu += std::clock() - groupStart - poolCpu;
+
             // Write remaining records in output buffer
-            if (!outputBuffer.empty()) {
-                outputTape->write_block(outputBlockNum++, outputBuffer.data(), outputBuffer.size());
+            if (outputBuffer) {
+                pool->unpin(outputTape, outputBlockNum++, true);
             }
 
             // Display the merged run
@@ -217,19 +489,36 @@ void merge(Tape* tape, size_t bufferNumber) {
 
         Logger::log_verbose("\n\n");
 
+        double phaseCpuMs = 1000.0 * phaseCpu / CLOCKS_PER_SEC;
+        totalMergeCpu += phaseCpu;
+        bool kernelPhase = std::min(mergeWays, numRuns) <= kernelFanIn;
+        Logger::log_verbose("Phase %d merge CPU time %.3f ms without block I/O (%s merge)\n",
+                            phase, phaseCpuMs, kernelPhase ? get_merge_kernel_name() : "heap");
+
+        if (finalPhase && !pipelineDone) {
+            pipeline->finish();
+            pipelineDone = true;
+        }
+
+        pool->flush(outputTape);
         outputTape->close();
 
         // Swap tapes: copy output back to input
+        pool->drop(tape);
         tape->close();
         std::remove(tape->get_filename().c_str());
-        std::rename("temp_merge.bin", tape->get_filename().c_str());
+        std::rename(outputName.c_str(), tape->get_filename().c_str());
 
         if (!tape->open(std::ios::in | std::ios::out)) {
             Logger::log("Failed to reopen tape!\n");
+            pool->drop(outputTape);
             delete outputTape;
             return;
         }
 
+        // Cached output blocks are now blocks of the tape
+        pool->retarget(outputTape, tape);
+
         // Display complete state after this phase
         Logger::log_verbose("After phase %d - %zu runs:\n", phase, newRunCount);
         if(Logger::verbose)tape->display();
@@ -249,15 +538,21 @@ void merge(Tape* tape, size_t bufferNumber) {
     Logger::log("========================================\n\n");
 }
 
-void sort_tape(Tape *tape, size_t bufferNumber) {
+void sort_tape(Tape *tape, size_t bufferNumber, AggregatePipeline* pipeline, EvictionPolicy policy) {
+
+    // The only memory the sort uses for blocks, create_runs and merge share it
+    BufferPool pool(bufferNumber, policy);
 
-    create_runs(tape, bufferNumber);
-    merge(tape, bufferNumber);
+    create_runs(tape, bufferNumber, &pool);
+    merge(tape, bufferNumber, pipeline, &pool);
     Logger::log("Sorted file contents:\n");
     tape->display();
 
     Logger::log_verbose("\nStats:\n");
-    Logger::log_verbose("Total merge phases %ld\n", totalPhases);
-    Logger::log_verbose("Total read count %ld\n",   Counts::totalReadCount);
-    Logger::log_verbose("Total write count %ld\n",  Counts::totalWriteCount);
+    Logger::log_verbose("Buffer pool hits %ld\n",   pool.get_hit_count());
+    Logger::log_verbose("Buffer pool misses %ld\n", pool.get_miss_count());
+    Logger::log_verbose("Total merge CPU time %.3f ms without block I/O\n", 1000.0 * totalMergeCpu.load() / CLOCKS_PER_SEC);
+    Logger::log_verbose("Total merge phases %ld\n", totalPhases.load());
+    Logger::log_verbose("Total read count %ld\n",   Counts::totalReadCount.load());
+    Logger::log_verbose("Total write count %ld\n",  Counts::totalWriteCount.load());
 }
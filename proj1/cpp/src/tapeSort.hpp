@@ -1,9 +1,16 @@
 #pragma once
 
 #include "tape.hpp"
+#include "aggregate.hpp"
+#include "bufferPool.hpp"
 #include <algorithm>
 #include <iostream>
 
-void create_runs(Tape *tape, size_t bufferNumber);
-void merge(Tape *tape, size_t bufferNumber);
-void sort_tape(Tape *tape, size_t bufferNumber);
+// Without a pool a private one of bufferNumber frames is used
+void create_runs(Tape *tape, size_t bufferNumber, BufferPool* pool = nullptr);
+// The pipeline, if given, sees every record of the last merge phase in order;
+// records it rejects are not written to the sorted tape
+void merge(Tape *tape, size_t bufferNumber, AggregatePipeline* pipeline = nullptr,
+           BufferPool* pool = nullptr);
+void sort_tape(Tape *tape, size_t bufferNumber, AggregatePipeline* pipeline = nullptr,
+               EvictionPolicy policy = EvictionPolicy::LRU);
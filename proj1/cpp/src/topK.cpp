@@ -0,0 +1,246 @@
+#include "topK.hpp"
+#include "tapeSort.hpp"
+#include <algorithm>
+#include <queue>
+#include <cstdio>
+#include "logger.hpp"
+
+// Pruned runs go to a unique file under $TMPDIR, so concurrent runs never share one
+#define TOP_K_SCRATCH_PREFIX "tape_top_k."
+
+// True when the first record should be kept in preference to the second.
+// A plain functor, so the per-record heap comparisons inline.
+template <bool Largest>
+struct RecordOrder {
+    bool operator()(const RecordType& a, const RecordType& b) const {
+        return Largest ? a > b : a < b;
+    }
+};
+
+// Writes records to consecutive blocks of an already opened tape
+static void write_records(Tape* out, std::vector<RecordType>& records) {
+    size_t recordsPerBlock = out->get_num_of_record_in_block();
+    size_t blocksNeeded = (records.size() + recordsPerBlock - 1) / recordsPerBlock;
+
+    for (size_t b = 0; b < blocksNeeded; ++b) {
+        size_t offset = b * recordsPerBlock;
+        size_t count = std::min(records.size() - offset, recordsPerBlock);
+        out->write_block(b, records.data() + offset, count);
+    }
+}
+
+// K fits in memory: one read pass keeping a bounded heap of the best K records
+template <typename Order>
+static void top_k_in_memory(Tape* tape, size_t k, std::vector<RecordType>& result) {
+    Order before;
+    // Heap top is the worst record kept so far
+    std::priority_queue<RecordType, std::vector<RecordType>, Order> heap(before);
+
+    size_t totalBlocks = tape->get_total_blocks();
+    std::vector<RecordType> block;
+
+    for (size_t b = 0; b < totalBlocks; ++b) {
+        if (!tape->read_block(b, block)) break;
+
+        for (const RecordType& record : block) {
+            if (heap.size() < k) {
+                heap.push(record);
+            } else if (before(record, heap.top())) {
+                heap.pop();
+                heap.push(record);
+            }
+        }
+    }
+
+    result.clear();
+    result.reserve(heap.size());
+    while (!heap.empty()) {
+        result.push_back(heap.top());
+        heap.pop();
+    }
+    std::sort(result.begin(), result.end());
+}
+
+// K larger than memory: form runs only from records that can still be in the
+// result, merge them and copy the wanted end of the merged scratch tape.
+// Returns the number of records written.
+template <typename Order>
+static size_t top_k_spill(Tape* tape, size_t k, bool largest, size_t bufferNumber, Tape* outputTape) {
+    Order before;
+    size_t totalBlocks = tape->get_total_blocks();
+    size_t recordsPerBlock = tape->get_num_of_record_in_block();
+    size_t runCapacity = bufferNumber * recordsPerBlock;
+
+    std::string scratchName = create_scratch_file(TOP_K_SCRATCH_PREFIX);
+    Tape scratch(scratchName, tape->get_block_size());
+    if (scratchName.empty() || !scratch.open(std::ios::in | std::ios::out | std::ios::trunc)) {
+        Logger::log("Failed to open scratch tape!\n");
+        if (!scratchName.empty()) std::remove(scratchName.c_str());
+        return 0;
+    }
+
+    std::vector<RecordType> buffer;
+    buffer.reserve(runCapacity);
+
+    // Worst record and size of every run written so far, used to bound the K-th record
+    std::vector<std::pair<RecordType, size_t>> runBounds;
+    RecordType threshold;
+    bool hasThreshold = false;
+    size_t runIndex = 0;
+    size_t candidates = 0;
+    size_t discarded = 0;
+
+    Logger::log_verbose("Creating pruned runs...\n");
+
+    auto flush_run = [&]() {
+        if (buffer.empty()) return;
+        std::sort(buffer.begin(), buffer.end());
+
+        size_t blocksNeeded = (buffer.size() + recordsPerBlock - 1) / recordsPerBlock;
+        for (size_t b = 0; b < blocksNeeded; ++b) {
+            size_t offset = b * recordsPerBlock;
+            size_t count = std::min(buffer.size() - offset, recordsPerBlock);
+            scratch.write_block(runIndex * bufferNumber + b, buffer.data() + offset, count);
+        }
+
+        runBounds.push_back({largest ? buffer.front() : buffer.back(), buffer.size()});
+        candidates += buffer.size();
+        runIndex++;
+        buffer.clear();
+
+        // At least K records are no worse than the bound where the run sizes reach K
+        std::sort(runBounds.begin(), runBounds.end(),
+                  [&](const auto& a, const auto& b) { return before(a.first, b.first); });
+        size_t covered = 0;
+        for (const auto& [bound, count] : runBounds) {
+            covered += count;
+            if (covered >= k) {
+                threshold = bound;
+                hasThreshold = true;
+                break;
+            }
+        }
+    };
+
+    std::vector<RecordType> block;
+    for (size_t b = 0; b < totalBlocks; ++b) {
+        if (!tape->read_block(b, block)) break;
+
+        for (const RecordType& record : block) {
+            if (hasThreshold && before(threshold, record)) {
+                discarded++;
+                continue;
+            }
+            buffer.push_back(record);
+            if (buffer.size() == runCapacity) flush_run();
+        }
+    }
+    flush_run();
+    scratch.close();
+
+    Logger::log_verbose("Formed %zu runs, discarded %zu records\n", runIndex, discarded);
+
+    merge(&scratch, bufferNumber);
+    scratch.close();
+
+    if (!scratch.open(std::ios::in)) {
+        Logger::log("Failed to reopen scratch tape!\n");
+        std::remove(scratchName.c_str());
+        std::remove((scratchName + ".merge.tmp").c_str());
+        return 0;
+    }
+
+    // Merged scratch is ascending, so the largest records are at its end
+    size_t wanted = std::min(k, candidates);
+    size_t written = wanted;
+    size_t skip = largest ? candidates - wanted : 0;
+    size_t scratchBlocks = scratch.get_total_blocks();
+    size_t outputBlockNum = 0;
+
+    std::vector<RecordType> outputBuffer;
+    outputBuffer.reserve(recordsPerBlock);
+
+    for (size_t b = 0; b < scratchBlocks && wanted > 0; ++b) {
+        if (!scratch.read_block(b, block)) break;
+
+        for (const RecordType& record : block) {
+            if (skip > 0) {
+                skip--;
+                continue;
+            }
+            if (wanted == 0) break;
+            outputBuffer.push_back(record);
+            wanted--;
+
+            if (outputBuffer.size() >= recordsPerBlock) {
+                outputTape->write_block(outputBlockNum++, outputBuffer.data(), outputBuffer.size());
+                outputBuffer.clear();
+            }
+        }
+    }
+    if (!outputBuffer.empty()) {
+        outputTape->write_block(outputBlockNum++, outputBuffer.data(), outputBuffer.size());
+    }
+
+    scratch.close();
+    std::remove(scratchName.c_str());
+    return written;
+}
+
+// Keeps the K records that come first in Order, returns how many were written
+template <typename Order>
+static size_t select_top_k(Tape* tape, size_t k, bool largest, size_t bufferNumber, Tape* outputTape) {
+    // One buffer is reserved for reading blocks of the tape
+    size_t heapCapacity = (bufferNumber - 1) * tape->get_num_of_record_in_block();
+
+    if (k <= heapCapacity) {
+        Logger::log_verbose("Selecting %zu records in memory\n", k);
+        std::vector<RecordType> result;
+        top_k_in_memory<Order>(tape, k, result);
+        write_records(outputTape, result);
+        return result.size();
+    }
+    if (bufferNumber < 3) {
+        // merge() needs at least two input buffers to shrink the number of runs
+        Logger::log("Need at least 3 buffers when K does not fit in memory\n");
+        return 0;
+    }
+    Logger::log_verbose("%zu records do not fit in %zu buffers, using pruned runs\n",
+                        k, bufferNumber);
+    return top_k_spill<Order>(tape, k, largest, bufferNumber, outputTape);
+}
+
+void top_k(Tape *tape, size_t k, bool largest, size_t bufferNumber, const std::string& outputName) {
+    if (!tape) return;
+
+    if (bufferNumber < 2) {
+        Logger::log("Need at least 2 buffers for top-k selection\n");
+        return;
+    }
+
+    if (!tape->open(std::ios::in)) {
+        Logger::log("Failed to open tape file!\n");
+        return;
+    }
+
+    Tape outputTape(outputName, tape->get_block_size());
+    if (!outputTape.open(std::ios::in | std::ios::out | std::ios::trunc)) {
+        Logger::log("Failed to open output tape!\n");
+        tape->close();
+        return;
+    }
+
+    size_t written = largest
+        ? select_top_k<RecordOrder<true>>(tape, k, largest, bufferNumber, &outputTape)
+        : select_top_k<RecordOrder<false>>(tape, k, largest, bufferNumber, &outputTape);
+
+    outputTape.close();
+    tape->close();
+
+    Logger::log("%s %zu records (%s):\n", largest ? "Latest" : "Earliest", written, outputName.c_str());
+    outputTape.display();
+
+    Logger::log_verbose("\nStats:\n");
+    Logger::log_verbose("Total read count %ld\n",   Counts::totalReadCount.load());
+    Logger::log_verbose("Total write count %ld\n",  Counts::totalWriteCount.load());
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "tape.hpp"
+#include <string>
+
+#define DEFAULT_TOP_K_FILENAME "top_k.bin"
+
+// Writes the K smallest (largest == false) or K largest (largest == true)
+// records of the tape, sorted ascending, to the output tape.
+void top_k(Tape *tape, size_t k, bool largest, size_t bufferNumber,
+           const std::string& outputName = DEFAULT_TOP_K_FILENAME);
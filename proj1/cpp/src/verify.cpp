@@ -0,0 +1,151 @@
+#include "verify.hpp"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "logger.hpp"
+
+// splitmix64 finalizer, spreads keys so that sums of different multisets rarely collide
+uint64_t record_checksum(time_record_type key) {
+    uint64_t x = key;
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+static VerifyResult verify_range(const std::string& filename, size_t blockSize,
+                                 size_t firstBlock, size_t lastBlock) {
+    VerifyResult result;
+    result.blocks = lastBlock - firstBlock;
+
+    std::ifstream in(filename, std::ios::binary);
+    if (!in.is_open()) {
+        result.readable = false;
+        return result;
+    }
+    in.seekg(firstBlock * blockSize, std::ios::beg);
+
+    size_t recordsPerBlock = blockSize / sizeof(time_record_type);
+    std::vector<time_record_type> chunk(VERIFY_CHUNK_BLOCKS * recordsPerBlock);
+    bool haveKey = false;
+    time_record_type previous = 0;
+
+    for (size_t block = firstBlock; block < lastBlock; block += VERIFY_CHUNK_BLOCKS) {
+        size_t blocks = std::min<size_t>(VERIFY_CHUNK_BLOCKS, lastBlock - block);
+        if (!in.read(reinterpret_cast<char*>(chunk.data()), blocks * blockSize)) {
+            result.readable = false;
+            return result;
+        }
+        Counts::totalReadCount += blocks;
+        if (Counts::jobCounts) Counts::jobCounts->readCount += blocks;
+
+        for (size_t i = 0; i < blocks * recordsPerBlock; ++i) {
+            time_record_type key = chunk[i];
+            if (key == 0) continue;
+
+            if (!haveKey) {
+                haveKey = true;
+                result.firstKey = key;
+                result.firstKeyBlock = i / recordsPerBlock + block - firstBlock;
+            } else if (key < previous && result.sorted) {
+                result.sorted = false;
+                result.unsortedBlock = i / recordsPerBlock + block - firstBlock;
+            }
+            previous = key;
+            result.records++;
+            result.checksum += record_checksum(key);
+        }
+    }
+    result.lastKey = previous;
+    return result;
+}
+
+void combine_verify(VerifyResult& into, const VerifyResult& next) {
+    size_t offset = into.blocks;
+    into.readable = into.readable && next.readable;
+    into.partialBytes += next.partialBytes;
+
+    if (into.sorted && into.records != 0 && next.records != 0 && next.firstKey < into.lastKey) {
+        into.sorted = false;
+        into.unsortedBlock = offset + next.firstKeyBlock;
+    }
+    if (into.sorted && !next.sorted) {
+        into.sorted = false;
+        into.unsortedBlock = offset + next.unsortedBlock;
+    }
+
+    if (into.records == 0 && next.records != 0) {
+        into.firstKey = next.firstKey;
+        into.firstKeyBlock = offset + next.firstKeyBlock;
+    }
+    if (next.records != 0) into.lastKey = next.lastKey;
+
+    into.records += next.records;
+    into.checksum += next.checksum;
+    into.blocks += next.blocks;
+}
+
+VerifyResult verify_tape(const std::string& filename, size_t blockSize, size_t threads) {
+    auto start = std::chrono::steady_clock::now();
+
+    VerifyResult result;
+    if (!std::ifstream(filename, std::ios::binary).is_open()) {
+        result.readable = false;
+        return result;
+    }
+
+    Tape tape(filename, blockSize);
+    size_t totalBlocks = tape.get_total_blocks();
+
+    // Records in a trailing partial block would be missed by the count and checksum
+    std::ifstream in(filename, std::ios::binary | std::ios::ate);
+    result.partialBytes = static_cast<size_t>(in.tellg()) - totalBlocks * blockSize;
+    if (result.partialBytes != 0) {
+        result.readable = false;
+        return result;
+    }
+
+    if (threads == 0) threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    // Ranges of at least one chunk, smaller ones cost more in seeks than they gain
+    threads = std::max<size_t>(1, std::min(threads, totalBlocks / VERIFY_CHUNK_BLOCKS));
+
+    std::vector<VerifyResult> ranges(threads);
+    Counts::JobCounts* jobCounts = Counts::jobCounts;
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t) {
+        size_t firstBlock = t * totalBlocks / threads;
+        size_t lastBlock = (t + 1) * totalBlocks / threads;
+        workers.emplace_back([&, t, firstBlock, lastBlock]() {
+            Counts::jobCounts = jobCounts;
+            ranges[t] = verify_range(filename, blockSize, firstBlock, lastBlock);
+        });
+    }
+    for (std::thread& worker : workers) worker.join();
+
+    for (const VerifyResult& range : ranges) combine_verify(result, range);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    Logger::log_verbose("Verified %s: %zu blocks on %zu threads in %.3f ms (%.1f MB/s)\n",
+                        filename.c_str(), totalBlocks, threads, seconds * 1000.0,
+                        seconds > 0 ? totalBlocks * blockSize / seconds / (1024.0 * 1024.0) : 0.0);
+    return result;
+}
+
+bool same_records(const VerifyResult& a, const VerifyResult& b) {
+    return a.readable && b.readable && a.records == b.records && a.checksum == b.checksum;
+}
+
+void log_verify_result(const std::string& name, const VerifyResult& result) {
+    if (result.partialBytes != 0) {
+        Logger::log("%s: ends with a partial block of %zu bytes\n", name.c_str(), result.partialBytes);
+        return;
+    }
+    if (!result.readable) {
+        Logger::log("%s: cannot be read\n", name.c_str());
+        return;
+    }
+    Logger::log("%s: %zu records, checksum %016llx, ", name.c_str(), result.records,
+                static_cast<unsigned long long>(result.checksum));
+    if (result.sorted) Logger::log("sorted\n");
+    else Logger::log("NOT sorted from block %zu\n", result.unsortedBlock);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "tape.hpp"
+#include <cstdint>
+
+// Blocks read per call by each verification thread
+#define VERIFY_CHUNK_BLOCKS 64
+
+struct VerifyResult {
+    bool readable = true;
+    bool sorted = true;
+    size_t records = 0;
+    size_t blocks = 0;
+    uint64_t checksum = 0;          // sum of hashed keys, independent of order
+    size_t unsortedBlock = 0;       // first block with a key smaller than the one before it
+    size_t firstKeyBlock = 0;       // block of the first record, for joining ranges
+    time_record_type firstKey = 0;
+    time_record_type lastKey = 0;
+    size_t partialBytes = 0;        // bytes after the last whole block, the tape never reads them
+};
+
+// Streams the tape once, split into block ranges checked on parallel threads.
+// Checks non-decreasing order across block boundaries, skipping zero padding,
+// and counts and checksums the records. threads == 0 uses every hardware thread.
+// A file that is not a whole number of blocks is reported unreadable.
+VerifyResult verify_tape(const std::string& filename, size_t blockSize, size_t threads = 0);
+
+// Checksum share of one record, the checksum of a multiset is the sum over its records
+uint64_t record_checksum(time_record_type key);
+
+// Appends the result of the tape that follows, as if both were one tape
+void combine_verify(VerifyResult& into, const VerifyResult& next);
+
+// True when both hold the same multiset of records
+bool same_records(const VerifyResult& a, const VerifyResult& b);
+
+void log_verify_result(const std::string& name, const VerifyResult& result);
@@ -6,7 +6,7 @@ BUFFER_NUMS=(4 16)
 
 # Create output file
 OUTPUT_FILE="sorting_results.txt"
-echo "RECORD_NUM BUFFER_NUM PHASES READ_COUNT WRITE_COUNT" > "$OUTPUT_FILE"
+echo "RECORD_NUM BUFFER_NUM PHASES READ_COUNT WRITE_COUNT MERGE_CPU_MS" > "$OUTPUT_FILE"
 
 # Loop through all combinations
 for RECORD_NUM in "${RECORD_NUMS[@]}"; do
@@ -23,9 +23,10 @@ for RECORD_NUM in "${RECORD_NUMS[@]}"; do
         phases=$(echo "$last_three_lines" | head -n 1 | awk '{print $4}')
         read_count=$(echo "$last_three_lines" | head -n 2 | tail -n 1 | awk '{print $4}')
         write_count=$(echo "$last_three_lines" | tail -n 1 | awk '{print $4}')
+        merge_cpu_ms=$(echo "$output" | grep "Total merge CPU time" | awk '{print $5}')
         
         # Write to output file
-        echo "$RECORD_NUM $BUFFER_NUM $phases $read_count $write_count" >> "$OUTPUT_FILE"
+        echo "$RECORD_NUM $BUFFER_NUM $phases $read_count $write_count $merge_cpu_ms" >> "$OUTPUT_FILE"
     done
 done
 